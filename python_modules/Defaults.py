@@ -84,12 +84,9 @@ def DefaultEnvironment(*args, **kw):
     """
     global _default_env
     if not _default_env:
-        import SCons.Util
         _default_env = SCons.Environment.Environment(*args, **kw)
-        if SCons.Util.md5:
-            _default_env.Decider('MD5')
-        else:
-            _default_env.Decider('timestamp-match')
+        # The decider of scons++ is global rather than per environment, so the
+        # default environment leaves whatever the scripts chose alone.
         global DefaultEnvironment
         DefaultEnvironment = _fetch_DefaultEnvironment
         _default_env._CacheDir_path = None
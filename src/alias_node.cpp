@@ -26,13 +26,14 @@ namespace
 {
     typedef std::map<std::string, sconspp::Node> AliasNamespace;
 	AliasNamespace alias_namespace;
+	sconspp::NodeArena<sconspp::Alias> aliases;
 }
 
 
 namespace sconspp
 {
 
-Alias::Alias(const std::string& name) : name_(name)
+Alias::Alias(const std::string& name) : node_properties(tag), name_(name)
 {
 }
 
@@ -49,7 +50,7 @@ Node add_alias(const std::string& name)
 	} else {
 		alias = add_vertex(graph);
 		alias_namespace[name] = alias;
-		graph[alias].reset(new Alias(name));
+		graph[alias] = aliases.create(name);
 	}
 
 	return alias;
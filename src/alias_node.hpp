@@ -27,10 +27,11 @@
 namespace sconspp
 {
 
-class Alias : public node_properties
+class Alias final : public node_properties
 {
 	std::string name_;
 	public:
+	static constexpr Type tag = Type::alias;
 	Alias(const std::string& name);
 	~Alias();
 	std::string name() const { return name_; }
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+// Measures adding, looking up and globbing the entries of a million file
+// tree in the filesystem node trie. The files don't need to exist.
+// Usage: bench_fs_trie
+
+#include "fs_node.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace sconspp;
+
+namespace
+{
+	double seconds_since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	long resident_kilobytes()
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while(std::getline(status, line))
+			if(line.compare(0, 6, "VmRSS:") == 0)
+				return std::stol(line.substr(6));
+		return 0;
+	}
+}
+
+int main()
+{
+	set_fs_root("/nonexistent/root");
+	// 10 top directories x 100 modules x 10 parts x 100 files
+	std::vector<std::string> names;
+	names.reserve(1000000);
+	for(int top = 0; top < 10; top++)
+		for(int module = 0; module < 100; module++)
+			for(int part = 0; part < 10; part++)
+				for(int file = 0; file < 100; file++)
+					names.push_back("src" + std::to_string(top) + "/mod" + std::to_string(module) +
+						"/part" + std::to_string(part) + "/file" + std::to_string(file) + ".cpp");
+
+	long memory_before = resident_kilobytes();
+	auto start = std::chrono::steady_clock::now();
+	for(const std::string& name : names)
+		add_entry(name, true);
+	std::cerr << "add_entry: " << seconds_since(start) << "s, " << (resident_kilobytes() - memory_before) / 1024 << " MB\n";
+
+	start = std::chrono::steady_clock::now();
+	std::size_t found = 0;
+	for(const std::string& name : names)
+		found += bool(get_entry(name));
+	std::cerr << "get_entry: " << seconds_since(start) << "s, " << found << " found\n";
+
+	start = std::chrono::steady_clock::now();
+	std::size_t globbed = 0;
+	for(int top = 0; top < 10; top++)
+		for(int module = 0; module < 100; module++)
+			globbed += glob("src" + std::to_string(top) + "/mod" + std::to_string(module) + "/*/*.cpp", false).size();
+	std::cerr << "glob of every module: " << seconds_since(start) << "s, " << globbed << " matches\n";
+
+	start = std::chrono::steady_clock::now();
+	globbed = glob("src*/mod*/part1/file1.cpp", false).size();
+	std::cerr << "glob across the tree: " << seconds_since(start) << "s, " << globbed << " matches\n";
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+// Measures hashing files for signatures, with the files in the page cache
+// or, given --cold, dropped from it before every run.
+// Usage: bench_hash_file [--cold] file or directory...
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem/operations.hpp>
+
+using namespace sconspp;
+
+namespace
+{
+	// Only pages that are clean get dropped, hence the sync
+	void drop_from_page_cache(const std::vector<std::string>& files)
+	{
+		sync();
+		for(const std::string& file : files) {
+			int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0)
+				continue;
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			close(fd);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool cold = false;
+	std::vector<std::string> files;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "--cold")
+			cold = true;
+		else if(boost::filesystem::is_directory(arg)) {
+			for(const auto& entry : boost::filesystem::directory_iterator(arg))
+				if(boost::filesystem::is_regular_file(entry.path()))
+					files.push_back(entry.path().string());
+		} else
+			files.push_back(arg);
+	}
+	if(files.empty()) {
+		std::cerr << "Usage: bench_hash_file [--cold] file or directory...\n";
+		return 1;
+	}
+
+	std::vector<double> times;
+	unsigned int checksum = 0;
+	for(int run = 0; run < 5; run++) {
+		if(cold)
+			drop_from_page_cache(files);
+		auto start = std::chrono::steady_clock::now();
+		for(const std::string& file : files)
+			checksum += ContentHash::hash_file(file)[0];
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	std::cerr << files.size() << " files, " << (cold ? "cold" : "warm") << " cache: median of 5 runs " << times[2] << "ms (" << checksum << ")\n";
+}
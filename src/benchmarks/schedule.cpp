@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+// Measures how long the taskmaster takes to schedule a big graph of tasks
+// that do nothing, so that only its own overhead is left.
+// Usage: bench_schedule [number of nodes] [jobs]
+
+#include "dependency_graph.hpp"
+#include "node_properties.hpp"
+#include "taskmaster.hpp"
+#include "action.hpp"
+#include "task.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem/operations.hpp>
+
+using namespace sconspp;
+
+namespace
+{
+	struct NoopAction : public Action
+	{
+		int execute(const Environment&) const { return 0; }
+		std::string to_string(const Environment&, bool) const { return std::string(); }
+	};
+
+	std::string no_subst(const Environment&, const std::string& input, bool) { return input; }
+	void no_setup(Environment&, const Task&) {}
+
+	double seconds_since(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::size_t num_nodes = argc > 1 ? std::stoul(argv[1]) : 1000000;
+	num_jobs = argc > 2 ? std::stoul(argv[2]) : 8;
+	always_build = true;
+	// Tasks echo their commands, empty lines here
+	std::cout.setstate(std::ios::failbit);
+
+	// Keep the signature database away from the current directory
+	boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories(dir);
+	boost::filesystem::current_path(dir);
+
+	auto start = std::chrono::steady_clock::now();
+	Environment::pointer env = Environment::create(no_subst, no_setup);
+	Action::pointer action = std::make_shared<NoopAction>();
+	Node end_goal = add_dummy_node("end_goal");
+	std::vector<Node> nodes;
+	nodes.reserve(num_nodes);
+	// Layers of 17 nodes, each depending on up to 3 nodes of earlier layers
+	for(std::size_t i = 0; i < num_nodes; i++) {
+		Node node = add_dummy_node(std::to_string(i));
+		for(std::size_t k = 1; k <= 3 && k * 17 <= i; k++)
+			add_edge(node, nodes[i - k * 17], graph);
+		Task::add_task(*env, { node }, {}, { action });
+		properties(node).task()->decider = &Task::timestamp_pure_decider;
+		nodes.push_back(node);
+	}
+	for(std::size_t i = num_nodes - std::min<std::size_t>(num_nodes, 1000); i < num_nodes; i++)
+		add_edge(end_goal, nodes[i], graph);
+	std::cerr << "graph construction: " << seconds_since(start) << "s\n";
+
+	start = std::chrono::steady_clock::now();
+	std::vector<Node> order;
+	for(int i = 0; i < 3; i++) {
+		order.clear();
+		build_order(end_goal, order);
+	}
+	std::cerr << "build_order: " << seconds_since(start) / 3 << "s per run\n";
+
+	start = std::chrono::steady_clock::now();
+	int num_built = build(end_goal);
+	std::cerr << "build of " << num_built << " tasks: " << seconds_since(start) << "s\n";
+
+	boost::filesystem::current_path(boost::filesystem::temp_directory_path());
+	boost::filesystem::remove_all(dir);
+}
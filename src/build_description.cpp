@@ -0,0 +1,455 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include "build_description.hpp"
+#include "node_properties.hpp"
+#include "fs_node.hpp"
+#include "alias_node.hpp"
+#include "scan_cpp.hpp"
+#include "taskmaster.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace sconspp
+{
+namespace build_description
+{
+
+bool enabled = false;
+
+namespace
+{
+	const char* const filename = "sconsppdesc.cache";
+	const char magic[] = "SCONSPP-DESC";
+	const std::uint32_t format_version = 1;
+
+	enum class ScannerKind : std::uint8_t { none, cpp };
+	enum class DeciderKind : std::uint8_t { database, timestamp_pure };
+
+	std::set<std::string> recorded_inputs;
+
+	// A command with variables already substituted, as ExecCommand would
+	// have them substituted for the task it belongs to.
+	class CachedCommand : public Action
+	{
+		std::string command_;
+		std::string signature_;
+
+		public:
+		CachedCommand(const std::string& command, const std::string& signature) : command_(command), signature_(signature) {}
+
+		int execute(const Environment&) const
+		{
+			std::vector<std::string> command;
+			std::string command_str = boost::algorithm::trim_copy(command_);
+			boost::algorithm::split(command, command_str, boost::is_any_of(" "), boost::token_compress_on);
+			return exec(command).first;
+		}
+		std::string to_string(const Environment&, bool for_signature) const
+		{
+			return for_signature ? signature_ : command_;
+		}
+	};
+
+	std::string no_subst(const Environment&, const std::string& str, bool) { return str; }
+	void no_task_context(Environment&, const Task&) {}
+
+	// Modification time in nanoseconds and size, or -1 for both if the
+	// file doesn't exist
+	std::pair<std::int64_t, std::int64_t> file_stamp(const std::string& path)
+	{
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0)
+			return { -1, -1 };
+		return { std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec, st.st_size };
+	}
+
+	std::string executable_path()
+	{
+		return readlink("/proc/self/exe").string();
+	}
+
+	boost::array<unsigned char, 16> command_line_signature(int argc, char** argv)
+	{
+		MD5 md5;
+		for(int i = 1; i < argc; i++)
+			md5.append(std::string(argv[i], std::strlen(argv[i]) + 1));
+		return md5.finish();
+	}
+
+	boost::array<unsigned char, 16> environment_signature()
+	{
+		// Set by parent makes and shells anew for every run
+		static const std::set<std::string> volatile_vars { "MAKEFLAGS", "MFLAGS", "OLDPWD", "_" };
+		MD5 md5;
+		for(const auto& var : Environ::instance()) {
+			if(volatile_vars.count(var.first))
+				continue;
+			md5.append(var.first + '=' + var.second + '\0');
+		}
+		return md5.finish();
+	}
+
+	class Writer
+	{
+		std::string data_;
+
+		public:
+		void u8(std::uint8_t value) { data_ += char(value); }
+		void u32(std::uint32_t value) { data_.append(reinterpret_cast<const char*>(&value), sizeof value); }
+		void i64(std::int64_t value) { data_.append(reinterpret_cast<const char*>(&value), sizeof value); }
+		void str(const std::string& value) { u32(value.size()); data_ += value; }
+		void bytes(const boost::array<unsigned char, 16>& value) { data_.append(reinterpret_cast<const char*>(value.data()), value.size()); }
+		const std::string& data() const { return data_; }
+	};
+
+	struct truncated_description {};
+
+	class Reader
+	{
+		const std::string& data_;
+		std::size_t pos_ = 0;
+
+		void need(std::size_t size) { if(data_.size() - pos_ < size) throw truncated_description(); }
+
+		public:
+		Reader(const std::string& data) : data_(data) {}
+		std::uint8_t u8() { need(1); return data_[pos_++]; }
+		std::uint32_t u32() { std::uint32_t value; need(sizeof value); std::memcpy(&value, &data_[pos_], sizeof value); pos_ += sizeof value; return value; }
+		std::int64_t i64() { std::int64_t value; need(sizeof value); std::memcpy(&value, &data_[pos_], sizeof value); pos_ += sizeof value; return value; }
+		std::string str() { std::uint32_t size = u32(); need(size); pos_ += size; return data_.substr(pos_ - size, size); }
+		boost::array<unsigned char, 16> bytes()
+		{
+			boost::array<unsigned char, 16> value;
+			need(value.size());
+			std::memcpy(value.data(), &data_[pos_], value.size());
+			pos_ += value.size();
+			return value;
+		}
+		bool at_end() const { return pos_ == data_.size(); }
+	};
+
+	// Returns why the graph can't be saved or an empty string if it can
+	std::string write_graph(Writer& out)
+	{
+		std::map<Node, std::uint32_t> indices;
+		std::vector<Node> nodes;
+		for(Node node : boost::make_iterator_range(vertices(graph))) {
+			indices[node] = nodes.size();
+			nodes.push_back(node);
+		}
+
+		out.str(get_fs_root().string());
+		out.u32(nodes.size());
+		for(Node node : nodes) {
+			const node_properties& props = properties(node);
+			out.u8(std::uint8_t(props.type_tag));
+			std::uint8_t flags = props.is_always_build() ? 1 : 0;
+			if(props.type_tag == node_properties::Type::fs) {
+				const FSEntry& entry = properties<FSEntry>(node);
+				std::string name = entry.name();
+				// Relative names are relative to the fs root rather than the current directory
+				out.str(path(name).is_absolute() ? name : "#" + name);
+				if(entry.is_file()) flags |= 2;
+				if(!entry.is_file()) flags |= 4;
+				if(entry.is_precious()) flags |= 8;
+				if(entry.change_detection == FSEntry::change_detection::timestamp_match) flags |= 16;
+				if(entry.change_detection == FSEntry::change_detection::stat_md5) flags |= 32;
+			} else {
+				out.str(props.name());
+			}
+			out.u8(flags);
+		}
+
+		out.u32(num_edges(graph));
+		for(Edge edge : boost::make_iterator_range(edges(graph))) {
+			out.u32(indices[source(edge, graph)]);
+			out.u32(indices[target(edge, graph)]);
+		}
+
+		std::vector<Task::pointer> tasks;
+		std::set<Task*> seen_tasks;
+		for(Node node : nodes) {
+			Task::pointer task = properties(node).task();
+			if(task && seen_tasks.insert(task.get()).second)
+				tasks.push_back(task);
+		}
+		out.u32(tasks.size());
+		for(const Task::pointer& task : tasks) {
+			out.u32(task->targets().size());
+			for(Node target : task->targets())
+				out.u32(indices[target]);
+			out.u32(task->sources().size());
+			for(Node source : task->sources())
+				out.u32(indices[source]);
+
+			Environment::const_pointer env = task->env();
+			out.u32(task->actions().size());
+			for(const Action::pointer& action : task->actions()) {
+				if(!dynamic_cast<const ExecCommand*>(action.get()))
+					return "actions of " + properties(task->targets().front()).name() + " aren't commands";
+				out.str(action->to_string(*env));
+				out.str(action->to_string(*env, true));
+			}
+
+			if(!task->has_scanner()) {
+				out.u8(std::uint8_t(ScannerKind::none));
+			} else {
+				const Task::Scanner& scanner = task->scanner();
+				auto function = scanner.target<void(*)(const Environment&, Node, Node)>();
+				if(!function || *function != &scan_cpp)
+					return "scanner of " + properties(task->targets().front()).name() + " isn't the C scanner";
+				out.u8(std::uint8_t(ScannerKind::cpp));
+				Variable::const_pointer cpppath = (*env)["CPPPATH"];
+				std::list<std::string> dirs;
+				if(cpppath)
+					dirs = cpppath->to_string_list();
+				out.u32(dirs.size());
+				for(const std::string& dir : dirs)
+					out.str(dir);
+			}
+			out.u8(std::uint8_t(task->decider == &Task::timestamp_pure_decider ? DeciderKind::timestamp_pure : DeciderKind::database));
+			out.str(task->pool());
+			out.u32(task->pool_weight());
+		}
+
+		for(const std::set<Node>* targets : { &default_targets, &command_line_targets }) {
+			out.u32(targets->size());
+			for(Node target : *targets)
+				out.u32(indices[target]);
+		}
+
+		out.u32(declared_pools().size());
+		for(const auto& pool : declared_pools()) {
+			out.str(pool.first);
+			out.u32(pool.second);
+		}
+		return std::string();
+	}
+
+	void read_graph(Reader& in)
+	{
+		std::string fs_root = in.str();
+		if(!fs_root.empty())
+			set_fs_root(fs_root);
+
+		std::vector<Node> nodes(in.u32());
+		for(Node& node : nodes) {
+			auto type = node_properties::Type(in.u8());
+			std::string name = in.str();
+			std::uint8_t flags = in.u8();
+			switch(type) {
+				case node_properties::Type::fs: {
+					boost::logic::tribool is_file = boost::logic::indeterminate;
+					if(flags & 2) is_file = true;
+					if(flags & 4) is_file = false;
+					node = add_entry(name, is_file);
+					FSEntry& entry = properties<FSEntry>(node);
+					if(flags & 8) entry.precious();
+					if(flags & 16) entry.change_detection = FSEntry::change_detection::timestamp_match;
+					if(flags & 32) entry.change_detection = FSEntry::change_detection::stat_md5;
+					break;
+				}
+				case node_properties::Type::alias:
+					node = add_alias(name);
+					break;
+				case node_properties::Type::dummy:
+					node = add_dummy_node(name);
+					break;
+			}
+			if(flags & 1)
+				properties(node).always_build();
+		}
+
+		for(std::uint32_t num_edges = in.u32(); num_edges; num_edges--) {
+			Node target = nodes.at(in.u32());
+			add_dependency(target, nodes.at(in.u32()));
+		}
+
+		Environment::pointer env = Environment::create(no_subst, no_task_context);
+		std::map<std::list<std::string>, Environment::pointer> scanner_envs;
+		for(std::uint32_t num_tasks = in.u32(); num_tasks; num_tasks--) {
+			NodeList targets(in.u32()), sources;
+			for(Node& target : targets)
+				target = nodes.at(in.u32());
+			sources.resize(in.u32());
+			for(Node& source : sources)
+				source = nodes.at(in.u32());
+			ActionList actions;
+			for(std::uint32_t num_actions = in.u32(); num_actions; num_actions--) {
+				std::string command = in.str();
+				actions.push_back(std::make_shared<CachedCommand>(command, in.str()));
+			}
+
+			Environment::pointer task_env = env;
+			Task::Scanner scanner;
+			if(ScannerKind(in.u8()) == ScannerKind::cpp) {
+				std::list<std::string> dirs;
+				for(std::uint32_t num_dirs = in.u32(); num_dirs; num_dirs--)
+					dirs.push_back(in.str());
+				// The C scanner caches search paths per environment
+				Environment::pointer& scanner_env = scanner_envs[dirs];
+				if(!scanner_env) {
+					scanner_env = Environment::create(no_subst, no_task_context);
+					(*scanner_env)["CPPPATH"] = make_variable(dirs.begin(), dirs.end());
+				}
+				task_env = scanner_env;
+				scanner = scan_cpp;
+			}
+			Task::add_task(*task_env, targets, sources, actions, scanner);
+			Task::pointer task = properties(targets.front()).task();
+			if(DeciderKind(in.u8()) == DeciderKind::timestamp_pure)
+				task->decider = &Task::timestamp_pure_decider;
+			std::string pool = in.str();
+			unsigned int weight = in.u32();
+			if(!pool.empty())
+				task->set_pool(pool, weight);
+		}
+
+		for(std::set<Node>* targets : { &default_targets, &command_line_targets })
+			for(std::uint32_t num_targets = in.u32(); num_targets; num_targets--)
+				targets->insert(nodes.at(in.u32()));
+
+		for(std::uint32_t num_pools = in.u32(); num_pools; num_pools--) {
+			std::string pool = in.str();
+			declare_pool(pool, in.u32());
+		}
+	}
+}
+
+void record_input(const std::string& path)
+{
+	recorded_inputs.insert(boost::filesystem::system_complete(path).lexically_normal().string());
+}
+
+const std::set<std::string>& inputs()
+{
+	return recorded_inputs;
+}
+
+bool load(int argc, char** argv)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if(!file)
+		return false;
+	std::string data { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+	try {
+		// Everything but the trailing checksum of the rest
+		if(data.size() < 16)
+			return false;
+		std::string payload = data.substr(0, data.size() - 16);
+		MD5 md5;
+		md5.append(payload);
+		auto checksum = md5.finish();
+		if(std::memcmp(checksum.data(), &data[payload.size()], checksum.size()) != 0) {
+			logging::warning() << "Ignoring corrupt " << filename << "\n";
+			return false;
+		}
+
+		Reader in(payload);
+		if(in.str() != magic || in.u32() != format_version)
+			return false;
+		if(in.bytes() != command_line_signature(argc, argv)) {
+			logging::debug() << "Build description is out of date: command line has changed\n";
+			return false;
+		}
+		if(in.bytes() != environment_signature()) {
+			logging::debug() << "Build description is out of date: environment has changed\n";
+			return false;
+		}
+		for(std::uint32_t num_inputs = in.u32(); num_inputs; num_inputs--) {
+			std::string path = in.str();
+			std::int64_t mtime = in.i64(), size = in.i64();
+			if(file_stamp(path) != std::make_pair(mtime, size)) {
+				logging::debug() << "Build description is out of date: " << path << " has changed\n";
+				return false;
+			}
+		}
+
+		read_graph(in);
+		if(!in.at_end())
+			throw truncated_description();
+	} catch(const truncated_description&) {
+		// The checksum matched, so this is a bug rather than a damaged file
+		throw std::runtime_error(std::string("Malformed ") + filename + ". Delete it and try again.");
+	}
+	logging::debug() << "Loaded build description from " << filename << "\n";
+	return true;
+}
+
+void save(int argc, char** argv)
+{
+	Writer out;
+	out.str(magic);
+	out.u32(format_version);
+	out.bytes(command_line_signature(argc, argv));
+	out.bytes(environment_signature());
+	std::set<std::string> all_inputs = recorded_inputs;
+	all_inputs.insert(executable_path());
+	out.u32(all_inputs.size());
+	for(const std::string& input : all_inputs) {
+		auto stamp = file_stamp(input);
+		out.str(input);
+		out.i64(stamp.first);
+		out.i64(stamp.second);
+	}
+
+	std::string reason = write_graph(out);
+	if(!reason.empty()) {
+		logging::debug() << "Not caching build description: " << reason << "\n";
+		std::remove(filename);
+		return;
+	}
+
+	MD5 md5;
+	md5.append(out.data());
+	auto checksum = md5.finish();
+	std::string temp_filename = std::string(filename) + ".tmp";
+	{
+		std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+		file.write(out.data().data(), out.data().size());
+		file.write(reinterpret_cast<const char*>(checksum.data()), checksum.size());
+		if(!file) {
+			logging::warning() << "Failed to write " << temp_filename << "\n";
+			return;
+		}
+	}
+	if(std::rename(temp_filename.c_str(), filename) != 0)
+		logging::warning() << "Failed to write " << filename << ": " << strerror(errno) << "\n";
+}
+
+}
+}
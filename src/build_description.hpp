@@ -0,0 +1,50 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef BUILD_DESCRIPTION_HPP
+#define BUILD_DESCRIPTION_HPP
+
+#include <set>
+#include <string>
+
+/* Snapshot of the dependency graph with its tasks taken after the build
+ * scripts have run, so that the next run can skip running them as long as
+ * nothing they read has changed. What the scripts read is taken to be the
+ * command line, the process environment, the files recorded with
+ * record_input and the scons++ executable. Only graphs whose tasks run
+ * commands and use no scanner or the C scanner can be saved.
+ */
+namespace sconspp
+{
+namespace build_description
+{
+	extern bool enabled;
+
+	// Marks a file or directory as having been read by the build scripts
+	void record_input(const std::string& path);
+	const std::set<std::string>& inputs();
+
+	// Returns false if there is no snapshot or it's out of date
+	bool load(int argc, char** argv);
+	void save(int argc, char** argv);
+}
+}
+
+#endif
@@ -20,6 +20,8 @@
 
 #include "db.hpp"
 #include "node_properties.hpp"
+#include "trace.hpp"
+#include "util.hpp"
 
 #include <iostream>
 
@@ -210,8 +212,9 @@ namespace sconspp
 
 PersistentNodeData::PersistentNodeData(SQLite::Db& db, int id) : db(db), skip_write_(true), archive_record_(true)
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	SQLite::Statement read_data(db.handle(),
-		"select id, node_id, generation, type, name, existed, timestamp, signature, task_signature, task_status from nodes where id == ?1;");
+		"select id, node_id, generation, type, name, existed, timestamp, signature, task_signature, task_status, task_duration, mtime, size, inode, ctime from nodes where id == ?1;");
 	read_data.bind(1, id);
 	int read_data_result = read_data.step();
 	assert(read_data_result == SQLITE_ROW);
@@ -222,15 +225,21 @@ PersistentNodeData::PersistentNodeData(SQLite::Db& db, int id) : db(db), skip_wr
 	type_ = read_data.column<std::string>(3);
 	name_ = read_data.column<std::string>(4);
 	existed_ = read_data.column<boost::optional<bool> >(5);
-	timestamp_ = read_data.column<boost::optional<int> >(6);
+	timestamp_ = read_data.column<boost::optional<time_t> >(6);
 	signature_ = read_data.column<boost::optional<boost::array<unsigned char, 16> > >(7);
 	task_signature_ = read_data.column<boost::optional<boost::array<unsigned char, 16> > >(8);
 	task_status_ = read_data.column<boost::optional<int> >(9);
+	task_duration_ = read_data.column<boost::optional<int> >(10);
+	mtime_ = read_data.column<boost::optional<std::int64_t> >(11);
+	size_ = read_data.column<boost::optional<std::int64_t> >(12);
+	inode_ = read_data.column<boost::optional<std::int64_t> >(13);
+	ctime_ = read_data.column<boost::optional<std::int64_t> >(14);
 }
 
 PersistentNodeData::PersistentNodeData(SQLite::Db& db, Node node)
 	: type_(graph[node]->type()), name_(graph[node]->name()), db(db), node(node), skip_write_(false)
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	SQLite::Statement prepare_record(db.handle(),
 		"insert into nodes (generation,type,name,node_id) select 1, ?1, ?2, coalesce(max(node_id) + 1, 1) from nodes;");
 	prepare_record.bind(1, type_);
@@ -251,7 +260,7 @@ PersistentNodeData::PersistentNodeData(SQLite::Db& db, Node node)
 	generation_ = get_generation.column<int>(0);
 
 	SQLite::Statement read_data(db.handle(),
-		"select id, node_id, existed, timestamp, signature, task_signature, task_status from nodes where generation == ?1 and type == ?2 and name == ?3;");
+		"select id, node_id, existed, timestamp, signature, task_signature, task_status, task_duration, mtime, size, inode, ctime from nodes where generation == ?1 and type == ?2 and name == ?3;");
 	read_data.bind(1, generation_);
 	read_data.bind(2, type_);
 	read_data.bind(3, name_);
@@ -262,20 +271,26 @@ PersistentNodeData::PersistentNodeData(SQLite::Db& db, Node node)
 	assert(id_);
 	node_id_ = read_data.column<int>(1);
 	existed_ = read_data.column<boost::optional<bool> >(2);
-	timestamp_ = read_data.column<boost::optional<int> >(3);
+	timestamp_ = read_data.column<boost::optional<time_t> >(3);
 	signature_ = read_data.column<boost::optional<boost::array<unsigned char, 16> > >(4);
 	task_signature_ = read_data.column<boost::optional<boost::array<unsigned char, 16> > >(5);
 	task_status_ = read_data.column<boost::optional<int> >(6);
+	task_duration_ = read_data.column<boost::optional<int> >(7);
+	mtime_ = read_data.column<boost::optional<std::int64_t> >(8);
+	size_ = read_data.column<boost::optional<std::int64_t> >(9);
+	inode_ = read_data.column<boost::optional<std::int64_t> >(10);
+	ctime_ = read_data.column<boost::optional<std::int64_t> >(11);
 }
 
 PersistentNodeData::~PersistentNodeData()
 {
 	if(skip_write_)
 		return;
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	try {
 		graph[node]->record_persistent_data(*this);
 		SQLite::Statement write_data(db.handle(), 
-			"insert or replace into nodes (id, node_id, generation, type, name, existed, timestamp, signature, task_signature, task_status) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)");
+			"insert or replace into nodes (id, node_id, generation, type, name, existed, timestamp, signature, task_signature, task_status, task_duration, mtime, size, inode, ctime) values (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15)");
 		write_data.bind(1, id_);
 		write_data.bind(2, node_id_);
 		write_data.bind(3, generation_);
@@ -286,6 +301,11 @@ PersistentNodeData::~PersistentNodeData()
 		write_data.bind(8, signature_);
 		write_data.bind(9, task_signature_);
 		write_data.bind(10, task_status_);
+		write_data.bind(11, task_duration_);
+		write_data.bind(12, mtime_);
+		write_data.bind(13, size_);
+		write_data.bind(14, inode_);
+		write_data.bind(15, ctime_);
 		while(write_data.step() != SQLITE_DONE) {}
 		write_scanner_cache();
 
@@ -296,6 +316,7 @@ PersistentNodeData::~PersistentNodeData()
 
 std::set<int> PersistentNodeData::dependencies()
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	std::set<int> result;
 	SQLite::Statement get_dependencies(db.handle(),
 		"select source_id from dependencies where target_id == ?1");
@@ -307,6 +328,7 @@ std::set<int> PersistentNodeData::dependencies()
 
 boost::optional<int> PersistentNodeData::map_to_archive_dep(int id)
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	SQLite::Statement map_dependency(db.handle(),
 		"select source_id from dependencies where target_id == ?1"
 		" intersect "
@@ -323,6 +345,7 @@ boost::optional<int> PersistentNodeData::map_to_archive_dep(int id)
 
 void PersistentNodeData::bump_generation()
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	if(!archive_record_ && skip_write_)
 	{
 		generation_++; skip_write_ = false;
@@ -341,6 +364,7 @@ void PersistentNodeData::bump_generation()
 
 void PersistentNodeData::read_scanner_cache()
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	static SQLite::Statement get_includes(db.handle(),
 		"select include, system from scanner_cache where node_id == ?1");
 	get_includes.bind(1, node_id_);
@@ -353,6 +377,7 @@ void PersistentNodeData::read_scanner_cache()
 
 void PersistentNodeData::write_scanner_cache()
 {
+	std::lock_guard<std::recursive_mutex> lock { db.mutex() };
 	if(scanner_cache_)
 	{
 		static SQLite::Statement clear_record(db.handle(),
@@ -375,24 +400,54 @@ void PersistentNodeData::write_scanner_cache()
 
 PersistentData::PersistentData(const std::string& filename) : db_(filename)
 {
+	trace::Scope scope { "db", "Open signature database" };
 	db_.exec("PRAGMA foreign_keys=ON");
 	db_.exec("PRAGMA journal_mode=OFF");
 
-	const int current_db_version = 5;
+	const int current_db_version = 8;
 	int db_version = db_.exec<int>("PRAGMA user_version");
-	if(db_version < current_db_version) {
-		if(db_version > 0) {
-			std::cout << "Signature database has older version. It will be reinitialized." << std::endl;
-			db_.exec("drop table if exists scanner_cache");
-			db_.exec("drop table if exists dependencies");
-			db_.exec("drop table if exists nodes");
+	if(db_version == 5) {
+		// Version 6 only added task durations, tasks of version 5 records
+		// are estimated like ones that never ran
+		db_.exec("alter table nodes add column task_duration INTEGER");
+		db_version = 6;
+	}
+	if(db_version == 6) {
+		// Version 7 only added the stat signature columns, records from
+		// version 6 keep working with them left null
+		for(const char* column : { "mtime", "size", "inode", "ctime" })
+			db_.exec(std::string("alter table nodes add column ") + column + " INTEGER");
+		db_version = 7;
+	}
+	if(db_version == 7) {
+		// Version 8 records the hash algorithm, older ones always used MD5
+		db_.exec("create table settings (name TEXT PRIMARY KEY, value TEXT)");
+		db_.exec("insert into settings values ('hash', 'md5')");
+		db_version = current_db_version;
+		db_.exec("PRAGMA user_version = " + boost::lexical_cast<std::string>(current_db_version));
+	}
+
+	std::string hash_name = boost::lexical_cast<std::string>(hash_algorithm);
+	if(db_version == current_db_version) {
+		std::string db_hash_name = db_.exec<std::string>("select value from settings where name == 'hash'");
+		if(db_hash_name != hash_name) {
+			std::cout << "Signature database uses " << db_hash_name << " signatures. It will be reinitialized for " << hash_name << "." << std::endl;
+			drop_tables();
+			db_version = 0;
 		}
+	} else if(db_version < current_db_version && db_version > 0) {
+		std::cout << "Signature database has older version. It will be reinitialized." << std::endl;
+		drop_tables();
+		db_version = 0;
+	}
+
+	if(db_version == 0) {
 		// Assume user_version == 0 means newly created db.
 
 		db_.exec("PRAGMA user_version = " + boost::lexical_cast<std::string>(current_db_version));
 
 		db_.exec("create table if not exists nodes "
-			"(id INTEGER PRIMARY KEY, node_id INTEGER, generation INTEGER, type TEXT, name TEXT, existed INTEGER, timestamp INTEGER, signature BLOB, task_signature BLOB, task_status INTEGER)");
+			"(id INTEGER PRIMARY KEY, node_id INTEGER, generation INTEGER, type TEXT, name TEXT, existed INTEGER, timestamp INTEGER, signature BLOB, task_signature BLOB, task_status INTEGER, task_duration INTEGER, mtime INTEGER, size INTEGER, inode INTEGER, ctime INTEGER)");
 		db_.exec("create index if not exists node_identity_index on nodes (type, name)");
 		db_.exec("create unique index if not exists node_archive_index on nodes (generation, type, name)");
 		db_.exec("create index if not exists node_id_index on nodes (node_id)");
@@ -404,11 +459,22 @@ PersistentData::PersistentData(const std::string& filename) : db_(filename)
 		db_.exec("create table if not exists scanner_cache "
 			"(node_id INTEGER, include INTEGER, system BOOLEAN)");
 		db_.exec("create index if not exists scanner_cache_index on scanner_cache(node_id)");
+		db_.exec("create table if not exists settings (name TEXT PRIMARY KEY, value TEXT)");
+		db_.exec("insert into settings values ('hash', '" + hash_name + "')");
 	}
 }
 
+void PersistentData::drop_tables()
+{
+	db_.exec("drop table if exists scanner_cache");
+	db_.exec("drop table if exists dependencies");
+	db_.exec("drop table if exists nodes");
+	db_.exec("drop table if exists settings");
+}
+
 PersistentData::~PersistentData()
 {
+	trace::Scope scope { "db", "Write signature database" };
 	SQLite::Statement clear_dependency(db_.handle(),
 		"delete from dependencies where target_id = ?1");
 	SQLite::Statement write_dependency(db_.handle(), 
@@ -441,6 +507,7 @@ PersistentData::~PersistentData()
 
 PersistentNodeData& PersistentData::record_current_data(Node node)
 {
+	std::lock_guard<std::recursive_mutex> lock { db_.mutex() };
 	Nodes::iterator node_iter = nodes_.find(node);
 	if(node_iter == nodes_.end())
 		nodes_[node].reset(new PersistentNodeData(db_, node));
@@ -449,6 +516,7 @@ PersistentNodeData& PersistentData::record_current_data(Node node)
 
 PersistentNodeData& PersistentData::get_archive_data(int id)
 {
+	std::lock_guard<std::recursive_mutex> lock { db_.mutex() };
 	Archive::iterator archive_iter = archive_.find(id);
 	if(archive_iter == archive_.end())
 		archive_[id].reset(new PersistentNodeData(db_, id));
@@ -24,6 +24,9 @@
 #include <boost/optional.hpp>
 #include <boost/utility.hpp>
 #include <boost/array.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 
 #include "dependency_graph.hpp"
 
@@ -35,10 +38,13 @@ namespace SQLite
 class Db : public boost::noncopyable
 {
 	sqlite3* db;
+	std::recursive_mutex mutex_;
 	public:
 	explicit Db(const std::string& filename);
 	~Db();
 	sqlite3* handle() const { return db; }
+	// must be held while using the handle since up-to-date checks run in parallel
+	std::recursive_mutex& mutex() { return mutex_; }
 	void exec(const std::string& sql);
 	template<class T>
 	T exec(const std::string& sql);
@@ -62,6 +68,11 @@ class PersistentNodeData : public boost::noncopyable
 	boost::optional<boost::array<unsigned char, 16> > signature_;
 	boost::optional<boost::array<unsigned char, 16> > task_signature_;
 	boost::optional<int> task_status_;
+	boost::optional<int> task_duration_;
+	boost::optional<std::int64_t> mtime_;
+	boost::optional<std::int64_t> size_;
+	boost::optional<std::int64_t> inode_;
+	boost::optional<std::int64_t> ctime_;
 
 	typedef std::pair<bool, std::string> IncludeDep;
 	typedef std::set<IncludeDep> IncludeDeps;
@@ -73,6 +84,8 @@ class PersistentNodeData : public boost::noncopyable
 	bool skip_write_;
 	bool archive_record_ = false;
 
+	std::mutex mutex_;
+
 	public:
 	PersistentNodeData(SQLite::Db& db, int id);
 	PersistentNodeData(SQLite::Db& db, Node node);
@@ -87,6 +100,18 @@ class PersistentNodeData : public boost::noncopyable
 	boost::optional<boost::array<unsigned char, 16> >& task_signature() { return task_signature_; }
 	boost::optional<int> task_status() const { return task_status_; }
 	boost::optional<int>& task_status() { return task_status_; }
+	// wall-clock time the task building this node took last time, in milliseconds
+	boost::optional<int> task_duration() const { return task_duration_; }
+	boost::optional<int>& task_duration() { return task_duration_; }
+	// what stat said about the file, with times in nanoseconds
+	boost::optional<std::int64_t> mtime() const { return mtime_; }
+	boost::optional<std::int64_t>& mtime() { return mtime_; }
+	boost::optional<std::int64_t> size() const { return size_; }
+	boost::optional<std::int64_t>& size() { return size_; }
+	boost::optional<std::int64_t> inode() const { return inode_; }
+	boost::optional<std::int64_t>& inode() { return inode_; }
+	boost::optional<std::int64_t> ctime() const { return ctime_; }
+	boost::optional<std::int64_t>& ctime() { return ctime_; }
 
 	int id() const { return id_.get(); }
 	int node_id() const { return node_id_; }
@@ -102,6 +127,8 @@ class PersistentNodeData : public boost::noncopyable
 	void bump_generation();
 	boost::optional<int> prev_id() const { return prev_id_; }
 	bool is_archive() const { return archive_record_; }
+	// serializes up-to-date checks of the node from concurrently checked tasks
+	std::mutex& mutex() { return mutex_; }
 	private:
 	void read_scanner_cache();
 	void write_scanner_cache();
@@ -114,7 +141,8 @@ class PersistentData : public boost::noncopyable
 	Nodes nodes_;
 	typedef std::map<int, boost::shared_ptr<PersistentNodeData> > Archive;
 	Archive archive_;
-	bool do_clean_db_ = false;
+	std::atomic<bool> do_clean_db_ { false };
+	void drop_tables();
 	public:
 	explicit PersistentData(const std::string& filename);
 	~PersistentData();
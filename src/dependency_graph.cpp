@@ -19,12 +19,83 @@
  ***************************************************************************/
 
 #include "dependency_graph.hpp"
+#include "node_properties.hpp"
 
 namespace sconspp
 {
 
 Graph graph;
+std::mutex graph_mutex;
+FrozenGraph frozen_graph;
 std::set<Node> default_targets;
 std::set<Node> command_line_targets;
 
+void FrozenGraph::freeze(const Graph& graph)
+{
+	std::size_t num_ids = 0;
+	for(Node node : boost::make_iterator_range(vertices(graph)))
+		num_ids = std::max(num_ids, graph[node]->id + 1);
+
+	nodes_.assign(num_ids, Node());
+	dependencies_.offsets.assign(num_ids + 1, 0);
+	dependents_.offsets.assign(num_ids + 1, 0);
+	for(Node node : boost::make_iterator_range(vertices(graph))) {
+		std::size_t id = graph[node]->id;
+		nodes_[id] = node;
+		dependencies_.offsets[id + 1] = out_degree(node, graph);
+		for(Edge edge : boost::make_iterator_range(out_edges(node, graph)))
+			dependents_.offsets[graph[target(edge, graph)]->id + 1]++;
+	}
+	for(std::size_t id = 0; id < num_ids; id++) {
+		dependencies_.offsets[id + 1] += dependencies_.offsets[id];
+		dependents_.offsets[id + 1] += dependents_.offsets[id];
+	}
+
+	dependencies_.ids.resize(dependencies_.offsets[num_ids]);
+	dependents_.ids.resize(dependents_.offsets[num_ids]);
+	std::vector<std::size_t> dependents_filled(dependents_.offsets.begin(), dependents_.offsets.end() - 1);
+	for(Node node : boost::make_iterator_range(vertices(graph))) {
+		std::size_t id = graph[node]->id;
+		std::size_t pos = dependencies_.offsets[id];
+		for(Edge edge : boost::make_iterator_range(out_edges(node, graph))) {
+			std::size_t dependency = graph[target(edge, graph)]->id;
+			dependencies_.ids[pos++] = dependency;
+			dependents_.ids[dependents_filled[dependency]++] = id;
+		}
+	}
+	dependencies_.overflow.clear();
+	dependents_.overflow.clear();
+	frozen_ = true;
+}
+
+void FrozenGraph::thaw()
+{
+	dependencies_ = Edges();
+	dependents_ = Edges();
+	std::vector<Node>().swap(nodes_);
+	frozen_ = false;
+}
+
+void FrozenGraph::add_overflow_edge(Node target, Node dependency)
+{
+	std::size_t target_id = graph[target]->id, dependency_id = graph[dependency]->id;
+	// Scanners may have created either node after freezing
+	std::size_t max_id = std::max(target_id, dependency_id);
+	if(max_id >= nodes_.size())
+		nodes_.resize(max_id + 1);
+	nodes_[target_id] = target;
+	nodes_[dependency_id] = dependency;
+	dependencies_.add(target_id, dependency_id);
+	dependents_.add(dependency_id, target_id);
+}
+
+bool add_dependency(Node target, Node dependency)
+{
+	bool added;
+	boost::tie(boost::tuples::ignore, added) = add_edge(target, dependency, graph);
+	if(added && frozen_graph.frozen())
+		frozen_graph.add_overflow_edge(target, dependency);
+	return added;
+}
+
 }
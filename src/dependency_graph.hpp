@@ -22,7 +22,10 @@
 #define DEPENDENCY_GRAPH_HPP
 
 #include <boost/graph/adjacency_list.hpp>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace sconspp
 {
@@ -37,12 +40,93 @@ using boost::add_vertex;
 using boost::add_edge;
 
 class node_properties;
-typedef boost::adjacency_list<setS, listS, directedS, std::shared_ptr<node_properties> > Graph;
+// Vertex properties point into the arenas of node_properties' subclasses
+typedef boost::adjacency_list<setS, listS, directedS, node_properties*> Graph;
 typedef graph_traits<Graph>::vertex_descriptor Node;
 typedef graph_traits<Graph>::edge_descriptor Edge;
 typedef std::vector<Node> NodeList;
 
 extern Graph graph;
+// Held by scanners while they add nodes and edges, since scanning runs on many threads
+extern std::mutex graph_mutex;
+
+/* Copy of graph's edges in compressed sparse row layout, indexed by node id,
+ * so that traversals during a build read contiguous arrays instead of chasing
+ * a std::set per node. Edges added while frozen, as scanners do, are kept in
+ * a per node overflow buffer and come after the frozen ones.
+ */
+class FrozenGraph
+{
+	// Edges in both directions: dependencies and, for finding what's
+	// affected by a change, dependents.
+	struct Edges
+	{
+		std::vector<std::size_t> offsets;
+		std::vector<std::uint32_t> ids;
+		std::vector<std::vector<std::uint32_t>> overflow;
+
+		std::size_t num_frozen(std::size_t id) const
+		{
+			return id + 1 < offsets.size() ? offsets[id + 1] - offsets[id] : 0;
+		}
+		std::size_t size(std::size_t id) const
+		{
+			return num_frozen(id) + (id < overflow.size() ? overflow[id].size() : 0);
+		}
+		std::size_t at(std::size_t id, std::size_t i) const
+		{
+			std::size_t frozen = num_frozen(id);
+			return i < frozen ? ids[offsets[id] + i] : overflow[id][i - frozen];
+		}
+		void add(std::size_t id, std::uint32_t other)
+		{
+			if(id >= overflow.size())
+				overflow.resize(id + 1);
+			overflow[id].push_back(other);
+		}
+	};
+	Edges dependencies_;
+	Edges dependents_;
+	std::vector<Node> nodes_;
+	bool frozen_ = false;
+
+	public:
+	void freeze(const Graph& graph);
+	void thaw();
+	bool frozen() const { return frozen_; }
+
+	void add_overflow_edge(Node target, Node dependency);
+
+	Node node(std::size_t id) const { return nodes_[id]; }
+	std::size_t num_ids() const { return nodes_.size(); }
+
+	// Edges are addressed by index so that they can be iterated over
+	// while scanners add more.
+	std::size_t num_dependencies(std::size_t id) const { return dependencies_.size(id); }
+	std::size_t dependency_id(std::size_t id, std::size_t i) const { return dependencies_.at(id, i); }
+	Node dependency(std::size_t id, std::size_t i) const { return nodes_[dependency_id(id, i)]; }
+
+	std::size_t num_dependents(std::size_t id) const { return dependents_.size(id); }
+	std::size_t dependent_id(std::size_t id, std::size_t i) const { return dependents_.at(id, i); }
+};
+
+extern FrozenGraph frozen_graph;
+
+// Freezes graph for the lifetime of the guard unless it's frozen already
+class GraphFreeze
+{
+	bool thaw_;
+
+	public:
+	GraphFreeze() : thaw_(!frozen_graph.frozen()) { if(thaw_) frozen_graph.freeze(graph); }
+	~GraphFreeze() { if(thaw_) frozen_graph.thaw(); }
+	GraphFreeze(const GraphFreeze&) = delete;
+	GraphFreeze& operator=(const GraphFreeze&) = delete;
+};
+
+// Makes target depend on dependency. Returns false if it already did.
+bool add_dependency(Node target, Node dependency);
+
 extern std::set<Node> default_targets;
 extern std::set<Node> command_line_targets;
 
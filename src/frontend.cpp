@@ -23,6 +23,7 @@
 #include "frontend.hpp"
 #include "python_interface/python_interface.hpp"
 #include "make_interface/parse_make.hpp"
+#include "build_description.hpp"
 
 namespace sconspp
 {
@@ -91,8 +92,10 @@ void run_script(std::vector<std::pair<std::string, std::string>> overrides, std:
 			}
 			if(!script_found)
 				throw std::runtime_error("No Makefile found.");
-			else
+			else {
+				build_description::record_input(buildfile);
 				make_interface::run_makefile(buildfile, command_line_target_strings, overrides);
+			}
 		break;
 	}
 }
@@ -21,9 +21,21 @@
 #include "fs_node.hpp"
 #include "util.hpp"
 #include "db.hpp"
+#include "build_description.hpp"
+#include "log.hpp"
 
 #include <fnmatch.h>
-#include <numeric>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <unordered_set>
+#include <memory>
+#include <string_view>
 #include <boost/optional.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/unordered_map.hpp>
@@ -39,110 +51,457 @@ using sconspp::Node;
 using sconspp::NodeList;
 using sconspp::graph;
 
-struct fs_trie_node
+sconspp::NodeArena<sconspp::FSEntry> entries;
+
+// Every distinct path component is stored once. Components are referred to by
+// pointer, which stays valid as more are added.
+class PathComponents
+{
+	std::deque<string> strings_;
+	std::unordered_map<std::string_view, const string*> index_;
+
+	public:
+	const string* intern(std::string_view component)
+	{
+		auto it = index_.find(component);
+		if(it != index_.end())
+			return it->second;
+		const string* result = &strings_.emplace_back(component);
+		index_.emplace(*result, result);
+		return result;
+	}
+	const string* find(std::string_view component) const
+	{
+		auto it = index_.find(component);
+		return it == index_.end() ? nullptr : it->second;
+	}
+};
+
+PathComponents path_components;
+
+}
+
+namespace sconspp
 {
-	fs_trie_node() : children{{}} { }
 
+// An entry's path is its ancestors' components followed by its own. Roots
+// have "." or the root path of absolute paths as their component.
+struct fs_trie_node
+{
+	const fs_trie_node* parent;
+	const string* component;
 	optional<Node> node;
-	optional<fs_trie_node&> parent;
-	std::unordered_map<string, fs_trie_node*> children;
+	// Children are looked up by name through fs_trie's table, the list is
+	// for going through all of them
+	fs_trie_node* first_child = nullptr;
+	fs_trie_node* next_sibling = nullptr;
+
+	fs_trie_node(const fs_trie_node* parent, const string* component) : parent(parent), component(component) {}
+
+	string path() const
+	{
+		std::vector<const string*> components;
+		const fs_trie_node* root = this;
+		for(; root->parent; root = root->parent)
+			components.push_back(root->component);
+		if(components.empty())
+			return *root->component;
+		string result;
+		if(*root->component != ".") {
+			result = *root->component;
+			if(result.back() != '/')
+				result += '/';
+		}
+		for(auto component = components.rbegin(); component != components.rend(); ++component) {
+			if(component != components.rbegin())
+				result += '/';
+			result += **component;
+		}
+		return result;
+	}
+};
+
+}
+
+namespace
+{
+
+using sconspp::fs_trie_node;
+
+// Splits the root off a normalized path, "/" for absolute paths and "."
+// otherwise, leaving the rest in p
+std::string_view split_root(std::string_view& p)
+{
+	if(!p.empty() && p[0] == '/') {
+		p.remove_prefix(p.find_first_not_of('/') == std::string_view::npos ? p.size() : p.find_first_not_of('/'));
+		return "/";
+	}
+	return ".";
+}
+
+// Moves the next component of p into component. Returns false at the end.
+bool next_component(std::string_view& p, std::string_view& component)
+{
+	while(!p.empty()) {
+		std::size_t slash = p.find('/');
+		component = p.substr(0, slash);
+		p.remove_prefix(slash == std::string_view::npos ? p.size() : slash + 1);
+		if(!component.empty() && component != ".")
+			return true;
+	}
+	return false;
+}
+
+// A component of a glob pattern, prepared once to be matched against many names
+class GlobMatcher
+{
+	enum class Kind { literal, any, suffix, wildcard } kind_;
+	string pattern_;
+
+	public:
+	explicit GlobMatcher(std::string_view component) : pattern_(component)
+	{
+		std::size_t wildcard = pattern_.find_first_of("*?[");
+		if(wildcard == string::npos)
+			kind_ = Kind::literal;
+		else if(pattern_ == "*")
+			kind_ = Kind::any;
+		else if(wildcard == 0 && pattern_[0] == '*' && pattern_.find_first_of("*?[", 1) == string::npos)
+			kind_ = Kind::suffix;
+		else
+			kind_ = Kind::wildcard;
+	}
+
+	bool is_literal() const { return kind_ == Kind::literal; }
+	const string& literal() const { return pattern_; }
+
+	bool matches(const string& name) const
+	{
+		switch(kind_) {
+			case Kind::literal:
+				return name == pattern_;
+			case Kind::any:
+				return true;
+			case Kind::suffix:
+				return name.size() >= pattern_.size() - 1 &&
+					name.compare(name.size() - (pattern_.size() - 1), string::npos, pattern_, 1, string::npos) == 0;
+			case Kind::wildcard:
+				break;
+		}
+		return fnmatch(pattern_.c_str(), name.c_str(), FNM_NOESCAPE) == 0;
+	}
+};
+
+struct DirectoryEntry
+{
+	const string* name;
+	// False only if the directory listing said so
+	bool maybe_directory;
+};
+typedef std::vector<DirectoryEntry> DirectoryListing;
+
+struct linux_dirent64
+{
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+std::unordered_map<string, DirectoryListing> listings;
+std::unordered_map<string, optional<std::unordered_set<const string*>>> directory_contents;
+
+// Build scripts tend to glob the same directories over and over, so each is
+// read only once per run. Directories that don't exist list as empty.
+const DirectoryListing& list_directory(const string& directory)
+{
+	auto cached = listings.find(directory);
+	if(cached != listings.end())
+		return cached->second;
+
+	DirectoryListing& listing = listings[directory];
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		if(errno == ENOENT || errno == ENOTDIR)
+			return listing;
+		int error = errno;
+		listings.erase(directory);
+		throw boost::filesystem::filesystem_error("open", directory, boost::system::error_code(error, boost::system::system_category()));
+	}
+	alignas(linux_dirent64) char buffer[32 * 1024];
+	long length;
+	while((length = syscall(SYS_getdents64, fd, buffer, sizeof buffer)) > 0) {
+		for(long pos = 0; pos < length; ) {
+			const linux_dirent64& entry = *reinterpret_cast<const linux_dirent64*>(buffer + pos);
+			pos += entry.d_reclen;
+			std::string_view name { entry.d_name };
+			if(name == "." || name == "..")
+				continue;
+			listing.push_back({ path_components.intern(name), entry.d_type == DT_DIR || entry.d_type == DT_LNK || entry.d_type == DT_UNKNOWN });
+		}
+	}
+	int error = errno;
+	close(fd);
+	if(length < 0) {
+		listings.erase(directory);
+		throw boost::filesystem::filesystem_error("getdents64", directory, boost::system::error_code(error, boost::system::system_category()));
+	}
+	return listing;
+}
+
+// Whether directory has an entry called name, answered from its listing so
+// that find_file can rule out directories without a stat for each. Missing
+// directories contain nothing, and unreadable ones are assumed to contain
+// everything.
+bool directory_contains(const string& directory, std::string_view name)
+{
+	auto cached = directory_contents.find(directory);
+	if(cached == directory_contents.end()) {
+		cached = directory_contents.emplace(directory, boost::none).first;
+		try {
+			cached->second.emplace();
+			std::unordered_set<const string*>& names = *cached->second;
+			for(const DirectoryEntry& entry : list_directory(directory))
+				names.insert(entry.name);
+		} catch(const boost::filesystem::filesystem_error&) {
+			cached->second.reset();
+		}
+	}
+	if(!cached->second)
+		return true;
+	const string* interned = path_components.find(name);
+	return interned && cached->second->count(interned);
+}
+
+// Finds children of trie nodes by their parent and name. Slots hold the
+// children themselves, which know both, so a lookup costs one probe most of
+// the time and a node nothing more than a pointer or two of table space.
+class ChildTable
+{
+	std::vector<fs_trie_node*> slots_ = std::vector<fs_trie_node*>(1024);
+	std::size_t size_ = 0;
+
+	static std::size_t hash(const fs_trie_node* parent, const string* name)
+	{
+		std::size_t h = reinterpret_cast<std::uintptr_t>(parent) * 0x9E3779B97F4A7C15ull;
+		h ^= reinterpret_cast<std::uintptr_t>(name) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+		return h ^ (h >> 29);
+	}
+	std::size_t slot(const fs_trie_node* parent, const string* name) const
+	{
+		std::size_t mask = slots_.size() - 1;
+		std::size_t i = hash(parent, name) & mask;
+		while(slots_[i] && (slots_[i]->parent != parent || slots_[i]->component != name))
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	public:
+	fs_trie_node* find(const fs_trie_node* parent, const string* name) const
+	{
+		return slots_[slot(parent, name)];
+	}
+	void insert(fs_trie_node* child)
+	{
+		if(2 * (size_ + 1) > slots_.size()) {
+			std::vector<fs_trie_node*> old_slots(slots_.size() * 2);
+			old_slots.swap(slots_);
+			for(fs_trie_node* node : old_slots)
+				if(node)
+					slots_[slot(node->parent, node->component)] = node;
+		}
+		slots_[slot(child->parent, child->component)] = child;
+		size_++;
+	}
 };
 
 struct fs_trie
 {
-	typedef std::unordered_map<string, fs_trie_node> Trie;
-	Trie trie;
+	std::deque<fs_trie_node> nodes;
+	std::unordered_map<std::string_view, fs_trie_node*> roots;
+	ChildTable children;
 
-	fs_trie() : trie{{}} {}
+	// Returns the root p starts from and moves p past it
+	fs_trie_node& root(std::string_view& p)
+	{
+		std::string_view name = split_root(p);
+		fs_trie_node*& root = roots[name];
+		if(!root) {
+			const string* component = path_components.intern(name);
+			root = &nodes.emplace_back(nullptr, component);
+		}
+		return *root;
+	}
 
-	Node add_entry(const path& p, boost::logic::tribool is_file)
+	const fs_trie_node* child(const fs_trie_node& parent, const string* name) const
 	{
-		path::const_iterator iter = p.begin();
-		return add_entry(iter, p, is_file,  p.has_root_path() ? trie[p.root_path().string()] : trie["."]);
+		return parent.first_child ? children.find(&parent, name) : nullptr;
 	}
-	Node add_entry(path::const_iterator& iter, const path& entry_path, boost::logic::tribool is_file, fs_trie_node& parent)
+
+	Node add_entry(std::string_view p, boost::logic::tribool is_file)
 	{
-		if(iter == entry_path.end() || *iter == ".") {
-			if(!parent.node) {
-				parent.node = add_vertex(graph);
-				graph[parent.node.get()].reset(new sconspp::FSEntry(entry_path.string(), is_file));
+		fs_trie_node* parent = &root(p);
+		std::string_view component;
+		while(next_component(p, component)) {
+			const string* elem = path_components.intern(component);
+			fs_trie_node* child = parent->first_child ? children.find(parent, elem) : nullptr;
+			if(!child) {
+				child = &nodes.emplace_back(parent, elem);
+				child->next_sibling = parent->first_child;
+				parent->first_child = child;
+				children.insert(child);
 			}
-			return parent.node.get();
-		} else {
-			string elem { iter->string() };
-			++iter;
-			if(parent.children.count(elem) == 0) {
-				path new_path = std::accumulate(entry_path.begin(), iter, path{}, [](path x, path y) -> path { return x/y; });
-				parent.children[elem] = &trie[new_path.string()];
-				parent.children[elem]->parent = parent;
-			}
-			return add_entry(iter, entry_path, is_file, *parent.children[elem]);
+			parent = child;
+		}
+		if(!parent->node) {
+			parent->node = add_vertex(graph);
+			graph[parent->node.get()] = entries.create(*parent, is_file);
+		}
+		return parent->node.get();
+	}
+
+	optional<Node> get(std::string_view p) const {
+		auto root = roots.find(split_root(p));
+		if(root == roots.end())
+			return {};
+		const fs_trie_node* entry = root->second;
+		std::string_view component;
+		while(next_component(p, component)) {
+			const string* elem = path_components.find(component);
+			entry = elem ? child(*entry, elem) : nullptr;
+			if(!entry)
+				return {};
 		}
+		return entry->node;
 	}
 
-	optional<Node> get(const path& p) const {
-		return trie.count(p.string()) ? trie.find(p.string())->second.node : optional<Node>{};
+	static std::vector<GlobMatcher> compile(std::string_view pattern)
+	{
+		std::vector<GlobMatcher> matchers;
+		std::string_view component;
+		while(next_component(pattern, component))
+			matchers.emplace_back(component);
+		return matchers;
 	}
 
-	NodeList glob(const path& pattern)
+	NodeList glob(std::string_view pattern)
 	{
-		path::const_iterator iter = pattern.begin();
+		fs_trie_node& start = root(pattern);
+		std::vector<GlobMatcher> matchers = compile(pattern);
 		NodeList result;
-		glob(iter, pattern.end(), result, pattern.has_root_path() ? trie[pattern.root_path().string()] : trie["."]);
+		glob(matchers.begin(), matchers.end(), result, start);
 		return result;
 	}
-	void glob(path::const_iterator& iter, const path::const_iterator& iter_end, NodeList& result, const fs_trie_node& parent) const
+	void glob(std::vector<GlobMatcher>::const_iterator matcher, std::vector<GlobMatcher>::const_iterator matchers_end, NodeList& result, const fs_trie_node& parent) const
 	{
-		if(iter == iter_end) {
+		if(matcher == matchers_end) {
 			if(parent.node) {
 				result.push_back(parent.node.get());
 			}
 			return;
 		}
 
-		std::string pattern = iter->string();
-		path::iterator next_pattern = ++iter;
-		for(auto elem : parent.children) {
-			if(fnmatch(pattern.c_str(), elem.first.c_str(), FNM_NOESCAPE) == 0) {
-				glob(next_pattern, iter_end, result, *elem.second);
+		if(matcher->is_literal()) {
+			const string* name = path_components.find(matcher->literal());
+			if(const fs_trie_node* entry = name ? child(parent, name) : nullptr)
+				glob(matcher + 1, matchers_end, result, *entry);
+			return;
+		}
+		for(const fs_trie_node* entry = parent.first_child; entry; entry = entry->next_sibling) {
+			if(matcher->matches(*entry->component)) {
+				glob(matcher + 1, matchers_end, result, *entry);
 			}
 		}
 	}
 
-	NodeList glob_on_disk(const path& pattern, const path& directory)
+	// Patterns already looked up on disk. Since directory listings are cached
+	// doing it again would only add the same entries again.
+	std::unordered_set<string> globbed_on_disk;
+
+	NodeList glob_on_disk(std::string_view pattern, const string& directory)
 	{
-		path::const_iterator iter = pattern.begin();
-		NodeList result;
-		if(pattern.has_root_path()) {
-			glob_on_disk(++iter, pattern.end(), pattern.root_path());
-		} else {
-			glob_on_disk(iter, pattern.end(), directory);
+		std::string_view relative = pattern;
+		string start = split_root(relative) == "/" ? "/" : directory;
+		if(globbed_on_disk.insert(start + '\0' + string(pattern)).second) {
+			std::vector<GlobMatcher> matchers = compile(relative);
+			glob_on_disk(matchers.begin(), matchers.end(), start);
 		}
-		iter = pattern.begin();
-		glob(iter, pattern.end(), result, pattern.has_root_path() ? trie[pattern.root_path().string()] : trie["."]);
-		return result;
+		return glob(pattern);
 	}
-	void glob_on_disk(path::const_iterator& iter, const path::const_iterator& iter_end, const path& directory)
+	void glob_on_disk(std::vector<GlobMatcher>::const_iterator matcher, std::vector<GlobMatcher>::const_iterator matchers_end, const string& directory)
 	{
-		if(iter == iter_end) {
-			sconspp::add_entry(directory.string(),  boost::logic::indeterminate);
+		if(matcher == matchers_end) {
+			sconspp::add_entry(directory,  boost::logic::indeterminate);
 			return;
 		}
 
-		std::string pattern = iter->string();
-		path::iterator next_pattern = ++iter;
-		using boost::filesystem::directory_iterator;
-		for(directory_iterator i(directory); i != directory_iterator(); ++i) {
-			if(fnmatch(pattern.c_str(), i->path().filename().c_str(), FNM_NOESCAPE) == 0) {
-				glob_on_disk(next_pattern, iter_end, *i);
-			}
+		sconspp::build_description::record_input(directory);
+		bool last = matcher + 1 == matchers_end;
+		for(const DirectoryEntry& entry : list_directory(directory)) {
+			// Only directories can match the components that follow
+			if(!last && !entry.maybe_directory)
+				continue;
+			if(matcher->matches(*entry.name))
+				glob_on_disk(matcher + 1, matchers_end, directory.back() == '/' ? directory + *entry.name : directory + '/' + *entry.name);
 		}
 	}
 };
 
 boost::filesystem::path fs_root;
+// fs_root without the trailing slash, so "" for "/". Only set when fs_root is
+// plain enough for canonical_path's fast path to compare against it.
+optional<string> fs_root_prefix;
 fs_trie fs;
 
+// Writes head / tail into buffer normalized the way path::lexically_normal
+// does. head must be absolute. Returns false for inputs that are left to boost
+// because of its special cases: network roots, ".." above the root, and ".."
+// after a two character name containing a dot.
+bool normalize_path(std::string_view head, std::string_view tail, string& buffer)
+{
+	if(head.size() > 1 && head[1] == '/')
+		return false;
+	if(head == "/" && !tail.empty() && tail[0] == '/')
+		return false;
+
+	buffer.clear();
+	bool has_components = false;
+	for(std::string_view piece : { head, tail }) {
+		std::string_view component;
+		while(!piece.empty()) {
+			std::size_t slash = piece.find('/');
+			component = piece.substr(0, slash);
+			piece.remove_prefix(slash == std::string_view::npos ? piece.size() : slash + 1);
+			if(component.empty())
+				continue;
+			has_components = true;
+			if(component == ".")
+				continue;
+			if(component == "..") {
+				std::size_t last_slash = buffer.rfind('/');
+				if(last_slash == string::npos)
+					return false;
+				std::string_view last = std::string_view(buffer).substr(last_slash + 1);
+				if(last.size() == 2 && (last[0] == '.' || last[1] == '.'))
+					return false;
+				buffer.resize(last_slash);
+				continue;
+			}
+			buffer += '/';
+			buffer += component;
+		}
+	}
+
+	// A trailing slash or "." leaves a "." as the last element, which is kept
+	std::string_view last_piece = tail.empty() ? head : tail;
+	if(has_components && (last_piece.back() == '/' || last_piece == "." || (last_piece.size() > 1 && last_piece.substr(last_piece.size() - 2) == "/.")))
+		buffer += "/.";
+	if(buffer.empty())
+		buffer = "/";
+	return true;
+}
+
 }
 
 namespace sconspp
@@ -154,6 +513,9 @@ void set_fs_root(const path& path)
 	if(!path_is_set) {
 		fs_root = path.lexically_normal();
 		path_is_set = true;
+		string buffer;
+		if(normalize_path(fs_root.native(), {}, buffer) && buffer == fs_root.native() && fs_root.filename() != ".")
+			fs_root_prefix = buffer == "/" ? string() : buffer;
 	}
 	else
 		throw std::runtime_error("set_fs_root: path can be set only once");
@@ -161,6 +523,11 @@ void set_fs_root(const path& path)
 	assert(fs_root.is_absolute());
 }
 
+const path& get_fs_root()
+{
+	return fs_root;
+}
+
 path canonical_path(const path& name)
 {
 	path result = name.lexically_normal();
@@ -182,102 +549,331 @@ path canonical_path(const std::string& name)
 	return canonical_path(filename);
 }
 
-Node add_entry(const std::string& name, boost::logic::tribool is_file)
+std::string_view canonical_path(std::string_view name, std::string& buffer)
 {
-	return fs.add_entry(canonical_path(name), is_file);
+	char cwd[PATH_MAX];
+	std::string_view head, tail;
+	if(!name.empty() && (fs_root_prefix || fs_root.empty())) {
+		if(name[0] == '#') {
+			head = fs_root.native();
+			tail = name.substr(1);
+		} else if(name[0] == '/')
+			head = name;
+		else if(getcwd(cwd, sizeof cwd)) {
+			head = cwd;
+			tail = name;
+		}
+	}
+
+	if(head.empty() || !normalize_path(head, tail, buffer)) {
+		buffer = canonical_path(string(name)).native();
+		return buffer;
+	}
+
+	if(fs_root_prefix) {
+		const string& prefix = *fs_root_prefix;
+		std::string_view result = buffer;
+		if(result.compare(0, prefix.size(), prefix) == 0 && (result.size() == prefix.size() || result[prefix.size()] == '/')) {
+			result.remove_prefix(std::min(prefix.size() + 1, result.size()));
+			return result.empty() ? "." : result;
+		}
+	}
+	return buffer;
 }
-boost::optional<Node> get_entry(const std::string& name)
+
+Node add_entry(const std::string& name, boost::logic::tribool is_file)
 {
-	return fs.get(canonical_path(name));
+	thread_local string buffer;
+	return fs.add_entry(canonical_path(name, buffer), is_file);
 }
-
-inline boost::optional<Node> find_file_cached(const std::string& name, const std::vector<std::string>& directories)
+boost::optional<Node> get_entry(const std::string& name)
 {
-	typedef std::pair<
-		std::string, std::vector<std::string>
-		> FindPath;
-	typedef boost::unordered_map<
-		FindPath,
-		boost::optional<Node>
-		> FindCache;
-	static FindCache find_cache;
-	FindPath find_path(name, directories);
-	FindCache::iterator it = find_cache.find(find_path);
-	if(it != find_cache.end())
-		return it->second;
-	else {
-		boost::optional<Node> result = find_file(name, directories);
-		find_cache[find_path] = result;
-		return result;
-	}
+	thread_local string buffer;
+	return fs.get(canonical_path(name, buffer));
 }
 
-boost::optional<Node> find_file(const std::string& name, const std::vector<std::string>& directories, bool cached)
+boost::optional<Node> find_file(const std::string& name, const std::vector<std::string>& directories)
 {
-	if(cached)
-		return find_file_cached(name, directories);
+	thread_local string buffer, file;
 	for(const std::string& directory : directories) {
-		path p = canonical_path(directory.empty() ? "." : directory) / name;
+		std::string_view dir = canonical_path(directory.empty() ? "." : directory, buffer);
+		file.assign(dir[0] == '/' ? "" : "#");
+		file.append(dir);
+		file += '/';
+		file += name;
+		std::string_view p = canonical_path(file, buffer);
 		boost::optional<Node> result = fs.get(p);
 		if(result) return result;
-		if(!p.is_absolute())
-			p = fs_root / p;
-		if(exists(p))
-			return fs.add_entry(canonical_path(p), boost::logic::indeterminate);
+		const char* abspath = buffer.c_str();
+		if(p[0] != '/') {
+			file.assign(fs_root.native());
+			file += '/';
+			file.append(p);
+			abspath = file.c_str();
+		}
+		if(access(abspath, F_OK) == 0)
+			return fs.add_entry(p, boost::logic::indeterminate);
 	}
 	return boost::optional<Node>();
 }
 
+namespace
+{
+	// Directories of each search path, canonicalized
+	std::vector<std::vector<string>> search_paths;
+	boost::unordered_map<std::vector<string>, SearchPath> search_path_ids;
+	boost::unordered_map<std::pair<SearchPath, string>, SearchPath> extended_search_paths;
+
+	boost::unordered_map<string, unsigned int> file_name_ids;
+	// Keyed by file name id in the upper half and search path in the lower
+	std::unordered_map<std::uint64_t, optional<Node>> found_files;
+
+	SearchPath intern_canonical_search_path(std::vector<string>&& directories)
+	{
+		auto interned = search_path_ids.emplace(std::move(directories), search_paths.size());
+		if(interned.second)
+			search_paths.push_back(interned.first->first);
+		return interned.first->second;
+	}
+}
+
+SearchPath intern_search_path(const std::vector<std::string>& directories)
+{
+	std::vector<string> canonical_directories;
+	string buffer;
+	for(const std::string& directory : directories)
+		canonical_directories.emplace_back(canonical_path(directory.empty() ? "." : directory, buffer));
+	return intern_canonical_search_path(std::move(canonical_directories));
+}
+
+SearchPath extend_search_path(SearchPath search_path, const std::string& directory)
+{
+	auto extended = extended_search_paths.find(std::make_pair(search_path, directory));
+	if(extended != extended_search_paths.end())
+		return extended->second;
+	std::vector<string> directories = search_paths[search_path];
+	string buffer;
+	directories.emplace_back(canonical_path(directory.empty() ? "." : directory, buffer));
+	SearchPath result = intern_canonical_search_path(std::move(directories));
+	extended_search_paths[std::make_pair(search_path, directory)] = result;
+	return result;
+}
+
+boost::optional<Node> find_file(const std::string& name, SearchPath search_path)
+{
+	unsigned int name_id = file_name_ids.emplace(name, file_name_ids.size()).first->second;
+	auto cached = found_files.emplace(std::uint64_t(name_id) << 32 | search_path, boost::none);
+	optional<Node>& result = cached.first->second;
+	if(!cached.second)
+		return result;
+
+	thread_local string buffer, file, directory;
+	for(const string& dir : search_paths[search_path]) {
+		file.assign(dir[0] == '/' ? "" : "#");
+		file.append(dir);
+		file += '/';
+		file += name;
+		std::string_view p = canonical_path(file, buffer);
+		result = fs.get(p);
+		if(result)
+			break;
+
+		if(p[0] == '/')
+			file = buffer;
+		else {
+			file.assign(fs_root.native());
+			file += '/';
+			file.append(p);
+		}
+		std::size_t slash = file.rfind('/');
+		directory.assign(file, 0, slash == 0 ? 1 : slash);
+		std::string_view filename = std::string_view(file).substr(slash + 1);
+		if(filename != "." && !directory_contains(directory, filename))
+			continue;
+		if(access(file.c_str(), F_OK) == 0) {
+			result = fs.add_entry(p, boost::logic::indeterminate);
+			break;
+		}
+	}
+	return result;
+}
+
+void forget_file_lookups()
+{
+	found_files.clear();
+	listings.clear();
+	directory_contents.clear();
+}
+
 NodeList glob(const std::string& pattern, bool on_disk)
 {
+	thread_local string buffer;
 	if(on_disk)
-		return fs.glob_on_disk(canonical_path(pattern), fs_root);
+		return fs.glob_on_disk(canonical_path(pattern, buffer), fs_root.native());
 	else
-		return fs.glob(canonical_path(pattern));
+		return fs.glob(canonical_path(pattern, buffer));
 }
 
-FSEntry::FSEntry(path name, boost::logic::tribool is_file) : path_(name), is_file_(is_file)
+enum FSEntry::change_detection FSEntry::default_change_detection = FSEntry::change_detection::timestamp_md5;
+
+void set_decider(const std::string& name, bool from_command_line)
 {
-	if(name.is_absolute()) {
-		abspath_ = path_;
+	static bool set_from_command_line = false;
+	if(set_from_command_line && !from_command_line)
 		return;
-	}
-	if(name.filename_is_dot()) {
-		abspath_ = fs_root;
+
+	enum FSEntry::change_detection mode;
+	if(name == "MD5" || name == "content")
+		mode = FSEntry::change_detection::timestamp_md5;
+	else if(name == "MD5-timestamp" || name == "content-timestamp")
+		mode = FSEntry::change_detection::stat_md5;
+	else if(name == "timestamp-match")
+		mode = FSEntry::change_detection::timestamp_match;
+	else if(name == "timestamp-newer" || name == "make") {
+		// Rebuilding on any timestamp change rather than only on a newer one
+		// is the closest of the modes
+		logging::warning() << "Decider '" << name << "' is treated as 'timestamp-match'\n";
+		mode = FSEntry::change_detection::timestamp_match;
+	} else if(from_command_line)
+		throw std::runtime_error("Unsupported decider: '" + name + "'");
+	else {
+		logging::warning() << "Ignoring unsupported decider '" << name << "'\n";
 		return;
 	}
-	abspath_ = fs_root / path_;
+
+	set_from_command_line = from_command_line;
+	FSEntry::default_change_detection = mode;
+	for(Node node : boost::make_iterator_range(vertices(graph)))
+		if(properties(node).type_tag == FSEntry::tag)
+			properties<FSEntry>(node).change_detection = mode;
+}
+
+FSEntry::FSEntry(const fs_trie_node& entry, boost::logic::tribool is_file) : node_properties(tag), entry_(entry), is_file_(is_file)
+{
+}
+
+std::string FSEntry::name() const
+{
+	return entry_.path();
+}
+
+std::string FSEntry::abspath() const
+{
+	path entry_path { name() };
+	if(entry_path.is_absolute())
+		return entry_path.string();
+	if(entry_path.filename_is_dot())
+		return fs_root.string();
+	return (fs_root / entry_path).string();
+}
+
+const unsigned int FileStat::statx_mask = STATX_TYPE | STATX_SIZE | STATX_INO | STATX_MTIME | STATX_CTIME;
+
+FileStat FileStat::from_statx(const struct statx& buf)
+{
+	FileStat result;
+	result.exists = true;
+	result.is_directory = S_ISDIR(buf.stx_mode);
+	result.size = buf.stx_size;
+	result.inode = buf.stx_ino;
+	result.mtime = std::int64_t(buf.stx_mtime.tv_sec) * 1000000000 + buf.stx_mtime.tv_nsec;
+	result.ctime = std::int64_t(buf.stx_ctime.tv_sec) * 1000000000 + buf.stx_ctime.tv_nsec;
+	return result;
+}
+
+const FileStat& FSEntry::stat() const
+{
+	std::lock_guard<std::mutex> lock { cache_mutex_ };
+	return cached_stat();
+}
+
+const FileStat& FSEntry::cached_stat() const
+{
+	if(stat_)
+		return stat_.get();
+
+	std::string file = abspath();
+	FileStat result {};
+	struct statx buf;
+	if(statx(AT_FDCWD, file.c_str(), 0, FileStat::statx_mask, &buf) == 0) {
+		result = FileStat::from_statx(buf);
+	} else if(errno != ENOENT && errno != ENOTDIR) {
+		throw boost::filesystem::filesystem_error("statx", file, boost::system::error_code(errno, boost::system::system_category()));
+	}
+	stat_ = result;
+	return stat_.get();
+}
+
+namespace
+{
+	std::time_t to_seconds(std::int64_t nanoseconds)
+	{
+		std::time_t seconds = nanoseconds / 1000000000;
+		// Round towards negative infinity like st_mtime does
+		return nanoseconds % 1000000000 < 0 ? seconds - 1 : seconds;
+	}
+}
+
+std::time_t FSEntry::timestamp() const
+{
+	const FileStat& file_stat = stat();
+	if(!file_stat.exists)
+		throw boost::filesystem::filesystem_error("last_write_time", abspath(), boost::system::error_code(ENOENT, boost::system::system_category()));
+	return to_seconds(file_stat.mtime);
 }
 
 bool FSEntry::unchanged(PersistentNodeData& prev_data) const
 {
+	// The record is bumped only after the lock is released, since the db
+	// is locked before entries when records get written
+	std::unique_lock<std::mutex> lock { cache_mutex_ };
+	// Records are rewritten only after a bump, so one is also needed when
+	// just the size, inode or ctime differ for the record to catch up
+	bool stat_same = true;
 	if(!unchanged_ || prev_data.is_archive()) {
-		if(exists()) {
-			bool timestamp_same = (timestamp() == prev_data.timestamp());
-			if(!timestamp_same) prev_data.bump_generation();
+		const FileStat& file_stat = cached_stat();
+		if(file_stat.exists) {
+			// Records written before stat signatures existed only have seconds
+			bool timestamp_same = prev_data.mtime() ?
+				file_stat.mtime == prev_data.mtime() :
+				to_seconds(file_stat.mtime) == prev_data.timestamp();
+			stat_same = timestamp_same && prev_data.mtime() &&
+				std::int64_t(file_stat.size) == prev_data.size() &&
+				std::int64_t(file_stat.inode) == prev_data.inode() &&
+				file_stat.ctime == prev_data.ctime();
+			bool existed = (prev_data.existed() == boost::optional<bool>(true));
 			switch(change_detection) {
 				case change_detection::timestamp_match:
-					unchanged_ = (prev_data.existed() == boost::optional<bool>(true)) && timestamp_same;
+					unchanged_ = existed && timestamp_same;
 				break;
 
 				case change_detection::timestamp_md5:
-					unchanged_ = (prev_data.existed() == boost::optional<bool>(true)) &&
+					unchanged_ = existed &&
 						(timestamp_same ||
-						MD5::hash_file(abspath_.string()) == prev_data.signature());
+						ContentHash::hash_file(abspath()) == prev_data.signature());
+				break;
+
+				case change_detection::stat_md5:
+					unchanged_ = existed &&
+						(stat_same ||
+						ContentHash::hash_file(abspath()) == prev_data.signature());
 				break;
 			}
 		} else
 			unchanged_ = (prev_data.existed() == boost::optional<bool>(false));
 	}
-	if(!unchanged_.get()) prev_data.bump_generation();
-	return unchanged_.get();
+	bool result = unchanged_.get();
+	lock.unlock();
+	if(!stat_same || !result) prev_data.bump_generation();
+	return result;
 }
 
 std::string FSEntry::dir() const {
-	path result { path_.parent_path() };
-	if(!path_.is_absolute()) {
-		if(path_.begin() == --path_.end()) {
-			if(path_.filename_is_dot()) result = abspath_.parent_path();
+	path entry_path { name() };
+	path result { entry_path.parent_path() };
+	if(!entry_path.is_absolute()) {
+		if(entry_path.begin() == --entry_path.end()) {
+			if(entry_path.filename_is_dot()) result = path(abspath()).parent_path();
 			else result = ".";
 		}
 	}
@@ -287,13 +883,13 @@ std::string FSEntry::dir() const {
 
 std::string FSEntry::relpath() const
 {
-	path relpath = abspath_.lexically_relative(boost::filesystem::current_path());
+	path relpath = path(abspath()).lexically_relative(boost::filesystem::current_path());
 	return relpath.string();
 }
 
 std::string FSEntry::get_contents() const
 {
-	boost::filesystem::ifstream ifs(abspath_);
+	boost::filesystem::ifstream ifs { path(abspath()) };
 	std::ostringstream os;
 	os << ifs.rdbuf();
 	return os.str();
@@ -304,9 +900,18 @@ void FSEntry::record_persistent_data(PersistentNodeData& data)
 	bool entry_exists = exists();
 	data.existed() = entry_exists;
 	data.timestamp() = entry_exists ? timestamp() : boost::optional<time_t>();
+	if(entry_exists) {
+		const FileStat& file_stat = stat();
+		data.mtime() = file_stat.mtime;
+		data.size() = file_stat.size;
+		data.inode() = file_stat.inode;
+		data.ctime() = file_stat.ctime;
+	} else {
+		data.mtime() = data.size() = data.inode() = data.ctime() = boost::none;
+	}
 	if(unchanged(data))
 		return;
-	data.signature() = entry_exists ? MD5::hash_file(abspath_.string()) : boost::optional<boost::array<unsigned char, 16> >();
+	data.signature() = entry_exists ? ContentHash::hash_file(abspath()) : boost::optional<boost::array<unsigned char, 16> >();
 }
 
 }
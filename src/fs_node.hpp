@@ -21,27 +21,59 @@
 #ifndef FS_NODE_HPP
 #define FS_NODE_HPP
 
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
 #include <boost/logic/tribool.hpp>
 #include <boost/filesystem.hpp>
 
 #include "dependency_graph.hpp"
 #include "node_properties.hpp"
 
+struct statx;
+
 namespace sconspp
 {
 
 using boost::filesystem::path;
 
-class FSEntry : public node_properties
+struct fs_trie_node;
+
+// What a single statx of an entry tells, with times in nanoseconds
+struct FileStat
 {
-	path path_;
-	path abspath_;
+	bool exists;
+	bool is_directory;
+	std::uint64_t size;
+	std::uint64_t inode;
+	std::int64_t mtime;
+	std::int64_t ctime;
+
+	// Fields of struct statx that from_statx reads
+	static const unsigned int statx_mask;
+	static FileStat from_statx(const struct statx& buf);
+};
+
+class FSEntry final : public node_properties
+{
+	// Position in the trie of known entries, which holds the path
+	const fs_trie_node& entry_;
 	boost::logic::tribool is_file_;
 	mutable boost::optional<bool> unchanged_;
+	// Filled on first use and dropped when the entry gets rebuilt, so that
+	// deciders don't stat the same file over and over during a build
+	mutable boost::optional<FileStat> stat_;
+	// Guards the two caches above. Concurrent up-to-date checks reach the
+	// same entry as a source of several tasks, compared against different
+	// records, and as a target.
+	mutable std::mutex cache_mutex_;
+	const FileStat& cached_stat() const;
 	public:
-	FSEntry(path name, boost::logic::tribool is_file = boost::logic::indeterminate);
-	std::string name() const { return path_.string(); }
-	std::string abspath() const { return abspath_.string(); }
+	static constexpr Type tag = Type::fs;
+	FSEntry(const fs_trie_node& entry, boost::logic::tribool is_file = boost::logic::indeterminate);
+	std::string name() const;
+	std::string abspath() const;
 	std::string relpath() const;
 	const char* type() const { return "fs"; }
 
@@ -53,13 +85,19 @@ class FSEntry : public node_properties
 	void make_directory() { is_file_ = false; }
 
 	std::string dir() const;
-	std::string file() const { return path_.filename().string(); }
-	std::string suffix() const { return path_.extension().string(); }
+	std::string file() const { return path(name()).filename().string(); }
+	std::string suffix() const { return path(name()).extension().string(); }
 	std::string base() const { return name().substr(0, name().length() - suffix().length()); }
 	std::string filebase() const { return file().substr(0, file().length() - suffix().length()); }
 
-	bool exists() const { return boost::filesystem::exists(abspath_); }
-	std::time_t timestamp() const { return boost::filesystem::last_write_time(abspath_); }
+	const FileStat& stat() const;
+	bool has_stat() const { std::lock_guard<std::mutex> lock { cache_mutex_ }; return bool(stat_); }
+	void set_stat(const FileStat& stat) { std::lock_guard<std::mutex> lock { cache_mutex_ }; stat_ = stat; }
+	// For builds after the first one in the same process
+	void forget_unchanged() { std::lock_guard<std::mutex> lock { cache_mutex_ }; unchanged_.reset(); }
+	void forget_stat() { std::lock_guard<std::mutex> lock { cache_mutex_ }; unchanged_.reset(); stat_.reset(); }
+	bool exists() const { return stat().exists; }
+	std::time_t timestamp() const;
 
 	std::string get_contents() const;
 
@@ -70,28 +108,62 @@ class FSEntry : public node_properties
 	} deletion_policy_ = deletion_policy::on_fail;
 	public:
 	void precious() { deletion_policy_ = deletion_policy::precious; }
+	bool is_precious() const { return deletion_policy_ == deletion_policy::precious; }
 
 	enum class change_detection {
 		timestamp_md5,
-		timestamp_match
-	} change_detection = change_detection::timestamp_md5;
+		timestamp_match,
+		// Hashes only if mtime, size, inode or ctime differ from last time
+		stat_md5
+	};
+	// Mode of entries created from now on, see set_decider
+	static enum change_detection default_change_detection;
+	enum change_detection change_detection = default_change_detection;
 
 	void was_rebuilt(int status)
 	{
-		unchanged_.reset();
+		forget_stat();
 		if(deletion_policy_ == deletion_policy::on_fail && status != 0)
-			boost::filesystem::remove(abspath_);
+			boost::filesystem::remove(abspath());
 	}
 	void record_persistent_data(PersistentNodeData&);
 };
 
 void set_fs_root(const path& path);
+const path& get_fs_root();
 
 Node add_entry(const std::string& name, boost::logic::tribool is_file);
 boost::optional<Node> get_entry(const std::string& name);
-boost::optional<Node> find_file(const std::string& name, const std::vector<std::string>& directories, bool cached = false);
+boost::optional<Node> find_file(const std::string& name, const std::vector<std::string>& directories);
+
+// Search paths are interned so that lookups in them can be cached by id.
+// Relative directories are taken relative to the current directory at the time.
+typedef unsigned int SearchPath;
+SearchPath intern_search_path(const std::vector<std::string>& directories);
+SearchPath extend_search_path(SearchPath search_path, const std::string& directory);
+// Remembers results for the rest of the run, misses included. Directories are
+// listed once instead of checking each candidate file for existence.
+boost::optional<Node> find_file(const std::string& name, SearchPath search_path);
+// Drops the remembered lookups and directory listings for when the files on
+// disk may have changed since, like between the builds of watch mode
+void forget_file_lookups();
 NodeList glob(const std::string& pattern, bool on_disk = true);
 
+// Takes an SCons decider name: 'MD5' or 'content' for timestamp_md5,
+// 'MD5-timestamp' or 'content-timestamp' for stat_md5 and 'timestamp-match',
+// which 'timestamp-newer' and 'make' are approximated with. Other names throw
+// when given on the command line and are ignored with a warning otherwise.
+// Applies to all fs entries, known and future ones. Once set from the command
+// line, later calls from build scripts are ignored.
+void set_decider(const std::string& name, bool from_command_line = false);
+
+// Normalizes name and makes it relative to the fs root if it's below it. The
+// result refers to buffer or to a string literal.
+std::string_view canonical_path(std::string_view name, std::string& buffer);
+// Implementation of the above on top of boost::filesystem, which it falls back
+// to for unusual paths
+path canonical_path(const std::string& name);
+
 inline Node add_entry(const std::string& name)
 {
 	return add_entry(name, boost::logic::indeterminate);
@@ -28,6 +28,9 @@
 #include "options.hpp"
 #include "frontend.hpp"
 #include "util.hpp"
+#include "trace.hpp"
+#include "build_description.hpp"
+#include "watch.hpp"
 
 #include <fstream>
 
@@ -41,19 +44,40 @@ int main(int argc, char** argv)
 		std::vector<std::string> command_line_target_strings;
 		std::vector<std::pair<std::string, std::string>> overrides;
 		std::tie(command_line_target_strings, overrides) = parse_command_line(argc, argv);
-		run_script(overrides, command_line_target_strings, argc, argv);
+		bool description_loaded = false;
+		if(build_description::enabled) {
+			trace::Scope scope { "phase", "Load build description" };
+			description_loaded = build_description::load(argc, argv);
+		}
+		if(!description_loaded) {
+			{
+				trace::Scope scope { "phase", "Read build scripts" };
+				run_script(overrides, command_line_target_strings, argc, argv);
+			}
+			if(build_description::enabled)
+				build_description::save(argc, argv);
+		}
 
 		Node end_goal = add_dummy_node("The end goal");
 		if(!command_line_targets.empty()) {
 			for(auto node : command_line_targets) {
-				add_edge(end_goal, node, graph);
+				add_dependency(end_goal, node);
 			}
 		} else {
 			for(auto node : default_targets) {
-				add_edge(end_goal, node, graph);
+				add_dependency(end_goal, node);
 			}
 		}
-		build(end_goal);
+		if(watch::enabled) {
+			// A failing build is what the developer is about to fix, so keep watching
+			try {
+				build(end_goal);
+			} catch(const std::exception& e) {
+				logging::error() << e.what() << std::endl;
+			}
+			watch::run(end_goal);
+		} else
+			build(end_goal);
 	} catch(const std::exception& e) {
 		logging::error() << e.what() << std::endl;
 		return 1;
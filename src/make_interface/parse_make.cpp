@@ -9,6 +9,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <iostream>
 #include <fstream>
 
@@ -90,7 +91,7 @@ namespace sconspp { namespace make_interface {
 
 enum class special_target_type
 {
-	None=0, POSIX, PRECIOUS, PHONY
+	None=0, POSIX, PRECIOUS, PHONY, POOL
 };
 
 struct special_target_symbol_ : boost::spirit::x3::symbols<special_target_type>
@@ -100,6 +101,7 @@ struct special_target_symbol_ : boost::spirit::x3::symbols<special_target_type>
 			("POSIX", special_target_type::POSIX)
 			("PRECIOUS", special_target_type::PRECIOUS)
 			("PHONY", special_target_type::PHONY)
+			("POOL", special_target_type::POOL)
 		;
 	}
 } special_target_symbol;
@@ -185,6 +187,9 @@ public:
 struct make_rule_ast;
 std::list<std::pair<pattern, make_rule_ast>> patterns;
 
+// Pools and weights assigned with ".POOL name [weight]: targets..."
+std::map<Node, std::pair<std::string, unsigned int>> target_pools;
+
 void make_scanner(const Environment& env, Node target, Node source);
 
 struct make_rule_ast
@@ -215,6 +220,18 @@ struct make_rule_ast
 					if(!properties(node).task())
 						Task::add_task(env, { node }, {}, {});
 				}
+				break;
+			case special_target_type::POOL: {
+				if(targets.empty() || targets.size() > 2)
+					throw std::runtime_error(".POOL takes a pool name and optionally a weight: .POOL name [weight]: targets...");
+				unsigned int weight = targets.size() == 2 ? parse_positive_number(targets[1], "Weight of targets in pool '" + targets[0] + "'") : 1;
+				for(auto source : sources) {
+					auto node { add_entry(source) };
+					target_pools[node] = { targets[0], weight };
+					if(properties(node).task())
+						properties(node).task()->set_pool(targets[0], weight);
+				}
+			}
 		}
 	}
 	NodeList operator()(const Environment& env) const {
@@ -240,11 +257,16 @@ struct make_rule_ast
 		if(actions.empty()) { // if no commands given then only establish deps
 			for(auto target : target_nodes) {
 				for(auto source : source_nodes) {
-					add_edge(target, source, sconspp::graph);
+					add_dependency(target, source);
 				}
 			}
 		} else {
 			Task::add_task(env, target_nodes, source_nodes, actions, make_scanner);
+			for(auto target : target_nodes) {
+				auto pool { target_pools.find(target) };
+				if(pool != target_pools.end())
+					properties(target).task()->set_pool(pool->second.first, pool->second.second);
+			}
 
 			if(default_targets.empty() && !target_nodes.empty())
 				for(Node target : target_nodes)
@@ -500,6 +522,8 @@ void setup_make_task_context(Environment& env, const Task& task)
 }
 
 void make_scanner(const Environment& env, Node target, Node source) {
+	// pattern rules add nodes and tasks all over the graph
+	std::lock_guard<std::mutex> lock { graph_mutex };
 	if(properties(source).task()) return; // skip nodes that already have rules assigned
 	logging::debug(logging::Makefile) << "considering pattern rules for '" << properties(source).name() << "'\n";
 
@@ -522,6 +546,20 @@ void run_makefile(const std::string& makefile_path, std::vector<std::string> com
 		makefile);
 	assert(match);
 
+	// .POOLS = name:capacity... declares resource pools for use with .POOL
+	if(env.count(".POOLS")) {
+		std::vector<std::string> pools;
+		split_into(pools, env[".POOLS"]->to_string());
+		for(const auto& pool : pools) {
+			if(pool.empty())
+				continue;
+			auto colon { pool.rfind(':') };
+			if(colon == std::string::npos)
+				throw std::runtime_error("Pool declaration '" + pool + "' in .POOLS should be of form name:capacity");
+			declare_pool(pool.substr(0, colon), parse_positive_number(pool.substr(colon + 1), "Capacity of pool '" + pool.substr(0, colon) + "'"));
+		}
+	}
+
 	auto makefile_node = add_entry(makefile_path);
 	if(out_degree(makefile_node, sconspp::graph) > 0) { // there is a way to build the Makefile so we better update it
 		auto task = properties(makefile_node).task();
@@ -529,6 +567,8 @@ void run_makefile(const std::string& makefile_path, std::vector<std::string> com
 			task->decider = &Task::timestamp_pure_decider;
 		bool always_build_saved = always_build;
 		always_build = false; // Prevent infinite loop
+		auto affected_by_saved = affected_by;
+		affected_by = boost::none;
 		auto severity_saved = logging::min_severity;
 		logging::min_severity = 1;
 		if(sconspp::build(makefile_node) > 0) {
@@ -536,6 +576,7 @@ void run_makefile(const std::string& makefile_path, std::vector<std::string> com
 			throw restart_exception();
 		}
 		always_build = always_build_saved;
+		affected_by = affected_by_saved;
 		logging::min_severity = severity_saved;
 	}
 
@@ -0,0 +1,196 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "make_jobserver.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace sconspp
+{
+
+namespace
+{
+	bool fd_is_open(int fd)
+	{
+		return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+	}
+}
+
+void MakeJobserver::open_nonblocking_read_fd(const std::string& path)
+{
+	// O_NONBLOCK can't be set on the inherited read end itself since the flag
+	// is shared with every other process using it. Opening the pipe anew via
+	// /proc or the fifo's path gives an open file description of our own.
+	nonblocking_read_fd_ = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(nonblocking_read_fd_ == -1)
+		logging::warning(logging::Taskmaster) << "Failed to open jobserver " << path << ": " << strerror(errno) << ". Will run only one job at a time.\n";
+}
+
+std::unique_ptr<MakeJobserver> MakeJobserver::from_makeflags()
+{
+	std::string makeflags = Environ::instance().get("MAKEFLAGS");
+	std::vector<std::string> flags;
+	boost::split(flags, makeflags, boost::is_space(), boost::token_compress_on);
+
+	// make passes --jobserver-auth=R,W or, since 4.4, --jobserver-auth=fifo:PATH.
+	// --jobserver-fds is what make before 4.2 called it. Last one wins.
+	std::string auth;
+	for(const std::string& flag : flags) {
+		if(flag == "--")
+			break;
+		if(boost::starts_with(flag, "--jobserver-auth="))
+			auth = flag.substr(std::strlen("--jobserver-auth="));
+		else if(boost::starts_with(flag, "--jobserver-fds="))
+			auth = flag.substr(std::strlen("--jobserver-fds="));
+	}
+	if(auth.empty())
+		return nullptr;
+
+	std::unique_ptr<MakeJobserver> jobserver { new MakeJobserver };
+	if(boost::starts_with(auth, "fifo:")) {
+		std::string path = auth.substr(std::strlen("fifo:"));
+		jobserver->open_nonblocking_read_fd(path);
+		if(jobserver->nonblocking_read_fd_ == -1)
+			return jobserver;
+		jobserver->owns_fds_ = true;
+		jobserver->write_fd_ = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+		if(jobserver->write_fd_ == -1) {
+			logging::warning(logging::Taskmaster) << "Failed to open jobserver " << path << ": " << strerror(errno) << ". Will run only one job at a time.\n";
+			close(jobserver->nonblocking_read_fd_);
+			jobserver->nonblocking_read_fd_ = -1;
+		}
+		return jobserver;
+	}
+
+	std::vector<std::string> fds;
+	boost::split(fds, auth, boost::is_any_of(","));
+	int read_fd = -1, write_fd = -1;
+	if(fds.size() == 2) {
+		try {
+			read_fd = boost::lexical_cast<int>(fds[0]);
+			write_fd = boost::lexical_cast<int>(fds[1]);
+		} catch(const boost::bad_lexical_cast&) {
+			read_fd = write_fd = -1;
+		}
+	}
+	if(!fd_is_open(read_fd) || !fd_is_open(write_fd)) {
+		// make closes the jobserver fds for recipes it doesn't consider recursive.
+		logging::warning(logging::Taskmaster) << "Jobserver given in MAKEFLAGS(" << auth << ") is unavailable. "
+			"Prefix the command running scons++ with '+' in the parent Makefile to make it available.\n";
+		return nullptr;
+	}
+	jobserver->read_fd_ = read_fd;
+	jobserver->write_fd_ = write_fd;
+	jobserver->open_nonblocking_read_fd("/proc/self/fd/" + fds[0]);
+	return jobserver;
+}
+
+std::unique_ptr<MakeJobserver> MakeJobserver::serve(unsigned int num_jobs)
+{
+	int fds[2];
+	if(pipe(fds) == -1) {
+		logging::warning(logging::Taskmaster) << "Failed to create jobserver pipe: " << strerror(errno) << "\n";
+		return nullptr;
+	}
+	std::unique_ptr<MakeJobserver> jobserver { new MakeJobserver };
+	jobserver->read_fd_ = fds[0];
+	jobserver->write_fd_ = fds[1];
+	jobserver->owns_fds_ = true;
+	jobserver->open_nonblocking_read_fd("/proc/self/fd/" + boost::lexical_cast<std::string>(fds[0]));
+	if(jobserver->nonblocking_read_fd_ == -1)
+		return nullptr;
+
+	// This process holds the implicit token, the rest go to the pipe.
+	const std::string tokens(num_jobs - 1, '+');
+	if(write(jobserver->write_fd_, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size())) {
+		logging::warning(logging::Taskmaster) << "Failed to fill jobserver pipe: " << strerror(errno) << "\n";
+		return nullptr;
+	}
+
+	// Both ends stay open across exec so that children can use them. Options
+	// go before the variable overrides make puts after " -- ".
+	std::string options = " -j" + boost::lexical_cast<std::string>(num_jobs) +
+		" --jobserver-auth=" + boost::lexical_cast<std::string>(fds[0]) + "," + boost::lexical_cast<std::string>(fds[1]);
+	std::string makeflags = Environ::instance().get("MAKEFLAGS");
+	std::string::size_type overrides_pos = makeflags.find(" -- ");
+	if(boost::starts_with(makeflags, "-- "))
+		overrides_pos = 0;
+	if(overrides_pos == std::string::npos)
+		makeflags += options;
+	else
+		makeflags.insert(overrides_pos, options + (overrides_pos == 0 ? " " : ""));
+	setenv("MAKEFLAGS", makeflags.c_str(), 1);
+
+	return jobserver;
+}
+
+MakeJobserver::~MakeJobserver()
+{
+	while(!tokens_.empty())
+		release();
+	if(nonblocking_read_fd_ != -1)
+		close(nonblocking_read_fd_);
+	if(owns_fds_) {
+		if(read_fd_ != -1)
+			close(read_fd_);
+		if(write_fd_ != -1)
+			close(write_fd_);
+	}
+}
+
+bool MakeJobserver::try_acquire()
+{
+	if(nonblocking_read_fd_ == -1)
+		return false;
+	char token;
+	ssize_t result;
+	do {
+		result = read(nonblocking_read_fd_, &token, 1);
+	} while(result == -1 && errno == EINTR);
+	if(result != 1)
+		return false;
+	tokens_.push_back(token);
+	return true;
+}
+
+void MakeJobserver::release()
+{
+	char token = tokens_.back();
+	tokens_.pop_back();
+	ssize_t result;
+	do {
+		result = write(write_fd_, &token, 1);
+	} while(result == -1 && errno == EINTR);
+	if(result != 1)
+		logging::warning(logging::Taskmaster) << "Failed to return token to jobserver: " << strerror(errno) << "\n";
+}
+
+}
@@ -0,0 +1,65 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef MAKE_JOBSERVER_HPP
+#define MAKE_JOBSERVER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+
+namespace sconspp
+{
+
+/* Token pipe of GNU make's jobserver protocol. Every process that takes part
+ * in it may run one job for free and has to take a token from the pipe
+ * for every additional job it runs in parallel, giving it back when the
+ * job is done.
+ */
+class MakeJobserver : public boost::noncopyable
+{
+	int read_fd_ = -1, write_fd_ = -1;
+	// Separate open file description of the read end with O_NONBLOCK set
+	int nonblocking_read_fd_ = -1;
+	// Whether read_fd_ and write_fd_ were opened by this process
+	bool owns_fds_ = false;
+	std::vector<char> tokens_;
+
+	MakeJobserver() {}
+	void open_nonblocking_read_fd(const std::string& path);
+
+	public:
+	~MakeJobserver();
+
+	// Join the jobserver of the parent make if MAKEFLAGS has one
+	static std::unique_ptr<MakeJobserver> from_makeflags();
+	// Become a jobserver for child processes allowing num_jobs jobs in total
+	// and advertise it to them via MAKEFLAGS
+	static std::unique_ptr<MakeJobserver> serve(unsigned int num_jobs);
+
+	bool try_acquire();
+	void release();
+	std::size_t num_tokens() const { return tokens_.size(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "node_properties.hpp"
+#include "fs_node.hpp"
+#include "alias_node.hpp"
+
+namespace
+{
+	sconspp::NodeArena<sconspp::dummy_node> dummy_nodes;
+}
+
+namespace sconspp
+{
+
+std::string node_properties::name() const
+{
+	switch(type_tag) {
+		case Type::fs: return static_cast<const FSEntry*>(this)->name();
+		case Type::alias: return static_cast<const Alias*>(this)->name();
+		case Type::dummy: return static_cast<const dummy_node*>(this)->name();
+	}
+	return std::string();
+}
+
+const char* node_properties::type() const
+{
+	switch(type_tag) {
+		case Type::fs: return static_cast<const FSEntry*>(this)->type();
+		case Type::alias: return static_cast<const Alias*>(this)->type();
+		case Type::dummy: return static_cast<const dummy_node*>(this)->type();
+	}
+	return nullptr;
+}
+
+bool node_properties::unchanged(PersistentNodeData& prev_data) const
+{
+	switch(type_tag) {
+		case Type::fs: return static_cast<const FSEntry*>(this)->unchanged(prev_data);
+		case Type::alias: return static_cast<const Alias*>(this)->unchanged(prev_data);
+		case Type::dummy: return static_cast<const dummy_node*>(this)->unchanged(prev_data);
+	}
+	return false;
+}
+
+bool node_properties::needs_rebuild() const
+{
+	if(type_tag == Type::fs)
+		return static_cast<const FSEntry*>(this)->needs_rebuild();
+	return always_build_;
+}
+
+void node_properties::was_rebuilt(int status)
+{
+	if(type_tag == Type::fs)
+		static_cast<FSEntry*>(this)->was_rebuilt(status);
+}
+
+void node_properties::record_persistent_data(PersistentNodeData& data)
+{
+	if(type_tag == Type::fs)
+		static_cast<FSEntry*>(this)->record_persistent_data(data);
+}
+
+Node add_dummy_node(const std::string& name)
+{
+	Node node = add_vertex(graph);
+	graph[node] = dummy_nodes.create(name);
+	return node;
+}
+
+}
@@ -26,33 +26,72 @@
 #include "db.hpp"
 
 #include <boost/cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
 
 namespace sconspp
 {
 
+/* Node properties are allocated from per type arenas and never freed
+ * individually, so making a node costs neither a heap allocation of its own
+ * nor reference counting.
+ */
+template<class NodeClass> class NodeArena : boost::noncopyable
+{
+	static constexpr std::size_t chunk_size = 1024;
+	typedef typename std::aligned_storage<sizeof(NodeClass), alignof(NodeClass)>::type Storage;
+	std::vector<std::unique_ptr<Storage[]>> chunks_;
+	std::size_t size_ = 0;
+
+	public:
+	template<typename... Args> NodeClass* create(Args&&... args)
+	{
+		if(size_ % chunk_size == 0)
+			chunks_.emplace_back(new Storage[chunk_size]);
+		NodeClass* node = new(&chunks_.back()[size_ % chunk_size]) NodeClass(std::forward<Args>(args)...);
+		size_++;
+		return node;
+	}
+	~NodeArena()
+	{
+		for(std::size_t i = 0; i < size_; i++)
+			reinterpret_cast<NodeClass*>(&chunks_[i / chunk_size][i % chunk_size])->~NodeClass();
+	}
+};
+
 class node_properties
 {
 	boost::shared_ptr<Task> task_;
 
+	public:
+	// Queries made for every node during a build switch on this rather
+	// than going through a vtable.
+	enum class Type : std::uint8_t { fs, alias, dummy };
+	const Type type_tag;
+
 	protected:
 	bool always_build_;
 
 	public:
 	std::size_t id;
-	node_properties() : always_build_(false) { static size_t counter = 0; id = counter++; }
-	virtual ~node_properties() {}
-	virtual std::string name() const = 0;
-	virtual const char* type() const = 0;
+	explicit node_properties(Type type) : type_tag(type), always_build_(false) { static size_t counter = 0; id = counter++; }
+	std::string name() const;
+	const char* type() const;
 
-	virtual bool unchanged(PersistentNodeData&) const = 0;
-	virtual bool needs_rebuild() const { return always_build_; }
+	bool unchanged(PersistentNodeData&) const;
+	bool needs_rebuild() const;
 
 	void always_build() { always_build_ = true; }
+	bool is_always_build() const { return always_build_; }
 	Task::pointer task() const { return task_; }
 	void set_task(Task::pointer task) { task_ = task; }
 
-	virtual void was_rebuilt(int) {}
-	virtual void record_persistent_data(PersistentNodeData&) {}
+	void was_rebuilt(int);
+	void record_persistent_data(PersistentNodeData&);
 };
 
 inline node_properties& properties(Node node)
@@ -62,7 +101,10 @@ inline node_properties& properties(Node node)
 
 template<class NodeClass> inline NodeClass& properties(Node node)
 {
-	return *boost::polymorphic_cast<NodeClass*>(graph[node].get());
+	node_properties* props = graph[node];
+	if(props->type_tag != NodeClass::tag)
+		throw std::bad_cast();
+	return *static_cast<NodeClass*>(props);
 }
 
 struct IdMap
@@ -80,22 +122,18 @@ inline std::size_t get(const IdMap& map, Node node)
 	return map.graph[node]->id;
 }
 
-class dummy_node : public node_properties
+class dummy_node final : public node_properties
 {
 	std::string name_;
 	public:
-	dummy_node(const std::string& name) : name_(name) {}
+	static constexpr Type tag = Type::dummy;
+	dummy_node(const std::string& name) : node_properties(tag), name_(name) {}
 	std::string name() const { return name_; }
 	const char* type() const { return "dummy"; }
 	bool unchanged(PersistentNodeData&) const { return true; }
 };
 
-inline Node add_dummy_node(const std::string& name)
-{
-	Node node = add_vertex(graph);
-	graph[node].reset(new dummy_node(name));
-	return node;
-}
+Node add_dummy_node(const std::string& name);
 
 }
 
@@ -18,15 +18,25 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
  ***************************************************************************/
 
+#include <fstream>
 #include <vector>
 #include <boost/program_options.hpp>
 #include <boost/optional.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/filesystem/path.hpp>
 
 #include "options.hpp"
 #include "log.hpp"
 #include "taskmaster.hpp"
 #include "frontend.hpp"
 #include "environment.hpp"
+#include "trace.hpp"
+#include "build_description.hpp"
+#include "watch.hpp"
+#include "util.hpp"
+#include "fs_node.hpp"
 
 namespace sconspp
 {
@@ -50,6 +60,21 @@ static void validate(boost::any& v,
 	v = ret;
 }
 
+// git diff --name-only lists files relative to the top of the work tree
+// no matter where it's run from
+static boost::optional<boost::filesystem::path> git_top_level()
+{
+	try {
+		auto result = exec({ "git", "rev-parse", "--show-toplevel" }, true);
+		std::string top_level = boost::algorithm::trim_right_copy(result.second[0]);
+		if(result.first == 0 && !top_level.empty())
+			return boost::filesystem::path(top_level);
+	} catch(const std::exception& e) {
+		logging::debug() << e.what() << "\n";
+	}
+	return boost::none;
+}
+
 std::pair<std::vector<std::string>, std::vector<std::pair<std::string, std::string>>> parse_command_line(int argc, char** argv)
 {
 	boost::program_options::options_description desc("Usage: scons++ [option]... [target]...\nOptions");
@@ -60,9 +85,18 @@ std::pair<std::vector<std::string>, std::vector<std::pair<std::string, std::stri
 		("jobs,j", boost::program_options::value<optional_last_overrides<unsigned int> >()
 			->implicit_value(optional_last_overrides<unsigned int>(), "unlimited")
 			->default_value(optional_last_overrides<unsigned int>(0), "0"),
-			"Maximun number of parallel jobs. 0 means autodetect, no arg means unlimited")
+			"Maximun number of parallel jobs. 0 means autodetect, or leave it to the jobserver of parent make if there is one. No arg means unlimited")
 		("always-build,B", boost::program_options::bool_switch(), "Rebuild all tasks no matter whether they're up-to-date")
 		("keep-going,k", boost::program_options::bool_switch(), "Continue building after a task fails and build all targets that don't depend on failed targets")
+		("max-load,l", boost::program_options::value<double>(), "Don't start new jobs while the load average is above this value")
+		("max-memory-pressure", boost::program_options::value<double>(), "Don't start new jobs while the percentage of time tasks stalled on memory over the last 10 seconds is above this value. Requires Linux PSI")
+		("trace", boost::program_options::value<std::string>(), "Write a timeline of the build to this file in Chrome trace event format")
+		("affected-by", boost::program_options::value<std::vector<std::string> >(), "Build only targets that depend, directly or not, on this file. Can be repeated or given a comma-separated list")
+		("changed-since", boost::program_options::value<std::string>(), "Build only targets that depend on the files listed one per line in this file, such as the output of git diff --name-only. The files are taken relative to the top of the git work tree")
+		("cache-description", boost::program_options::bool_switch(), "Save the dependency graph after reading build scripts and reuse it instead of reading them again while the scripts, the files they globbed, the command line and the environment are unchanged")
+		("watch", boost::program_options::bool_switch(), "After building, keep watching files of the dependency graph and rebuild whenever they change")
+		("hash", boost::program_options::value<HashAlgorithm>(&hash_algorithm)->default_value(hash_algorithm), "Hash of file contents and commands in signatures. Possible values: 'md5', and 'xxh3' if built with libxxhash. Changing it reinitializes the signature database")
+		("decider", boost::program_options::value<std::string>(), "How to tell whether files changed, overriding Decider() in build scripts. Possible values: 'MD5' to hash files whose timestamp changed, 'MD5-timestamp' to hash files whose timestamp, size, inode or ctime changed, 'timestamp-match' to never hash")
 		("target,T", boost::program_options::value<std::vector<std::string> >(), "Specify build target(s)")
 		("override,D", boost::program_options::value<std::vector<std::string> >(), "Override construction variables")
 		("help,h", "Produce this message and exit")
@@ -97,6 +131,42 @@ std::pair<std::vector<std::string>, std::vector<std::pair<std::string, std::stri
 	sconspp::num_jobs = num_jobs.value;
 	always_build = vm["always-build"].as<bool>();
 	keep_going = vm["keep-going"].as<bool>();
+	build_description::enabled = vm["cache-description"].as<bool>();
+	watch::enabled = vm["watch"].as<bool>();
+	if(vm.count("decider"))
+		set_decider(vm["decider"].as<std::string>(), true);
+	if(vm.count("max-load"))
+		max_load = vm["max-load"].as<double>();
+	if(vm.count("max-memory-pressure"))
+		max_memory_pressure = vm["max-memory-pressure"].as<double>();
+	if(vm.count("trace"))
+		trace::start(vm["trace"].as<std::string>());
+	if(vm.count("affected-by")) {
+		affected_by.emplace();
+		std::vector<std::string> split_files;
+		for(const std::string& files : vm["affected-by"].as<std::vector<std::string>>())
+			for(const std::string& file : boost::algorithm::split(split_files, files, boost::algorithm::is_any_of(",")))
+				if(!file.empty())
+					affected_by->push_back(file);
+	}
+	if(vm.count("changed-since")) {
+		std::ifstream list_file(vm["changed-since"].as<std::string>());
+		if(!list_file)
+			throw std::runtime_error("Failed to open " + vm["changed-since"].as<std::string>());
+		if(!affected_by)
+			affected_by.emplace();
+		boost::optional<boost::filesystem::path> top_level = git_top_level();
+		if(!top_level)
+			logging::warning() << "Not in a git work tree, files listed in " << vm["changed-since"].as<std::string>() << " are taken relative to the current directory\n";
+		std::string file;
+		while(std::getline(list_file, file)) {
+			if(file.empty())
+				continue;
+			if(top_level && file[0] != '/')
+				file = (*top_level / file).string();
+			affected_by->push_back(file);
+		}
+	}
 
 	std::vector<std::string> targets;
 	if(vm.count("target")) {
@@ -30,6 +30,7 @@
 #include "builder_wrapper.hpp"
 #include "fs_node.hpp"
 #include "task.hpp"
+#include "util.hpp"
 #include "python_interface/environment_wrappers.hpp"
 #include "python_interface/subst.hpp"
 
@@ -85,12 +86,17 @@ class PythonScanner
 	}
 	void operator()(const Environment& env, Node target, Node source)
 	{
-		py::gil_scoped_acquire lock {};
 		std::set<Node> deps;
-		scan(env, source_scanner_, source, deps, get_path(env, source_scanner_, source, py::none(), target, source));
-		scan(env, target_scanner_, target, deps, get_path(env, target_scanner_, target, py::none(), target, source));
+		{
+			// Scanners may create nodes, hence the graph lock. It's always taken after the GIL.
+			py::gil_scoped_acquire gil {};
+			std::lock_guard<std::mutex> lock { graph_mutex };
+			scan(env, source_scanner_, source, deps, get_path(env, source_scanner_, source, py::none(), target, source));
+			scan(env, target_scanner_, target, deps, get_path(env, target_scanner_, target, py::none(), target, source));
+		}
+		std::lock_guard<std::mutex> lock { graph_mutex };
 		for(Node node : deps)
-			add_edge(target, node, graph);
+			add_dependency(target, node);
 	}
 };
 
@@ -322,7 +328,26 @@ NodeList call_builder_interface(const PythonBuilder& builder, const Environment&
 		source = target;
 		target = py::none();
 	}
-	return builder(env, target, source);
+	NodeList targets = builder(env, target, source);
+
+	// Resource pool is given either to the builder call or with POOL and POOL_WEIGHT variables
+	std::string pool;
+	if(kw.contains("pool"))
+		pool = extract_string_subst(env, kw["pool"]);
+	else if(env.count("POOL"))
+		pool = env.subst("${POOL}");
+	if(!pool.empty()) {
+		unsigned int weight = 1;
+		std::string what = "Weight of targets in pool '" + pool + "'";
+		if(kw.contains("pool_weight"))
+			weight = parse_positive_number(py::str(kw["pool_weight"]), what);
+		else if(env.count("POOL_WEIGHT"))
+			weight = parse_positive_number(env.subst("${POOL_WEIGHT}"), what);
+		for(Node node : targets)
+			if(Task::pointer task = graph[node]->task())
+				task->set_pool(pool, weight);
+	}
+	return targets;
 }
 
 void PythonBuilder::add_action(py::object suffix, py::object action)
@@ -22,7 +22,9 @@
 #include "python_interface/directives.hpp"
 
 #include "util.hpp"
+#include "log.hpp"
 #include "environment.hpp"
+#include "taskmaster.hpp"
 #include "python_interface/action_wrapper.hpp"
 #include "python_interface/node_wrapper.hpp"
 #include "python_interface/subst.hpp"
@@ -116,7 +118,7 @@ void Depends(py::object target, py::object dependency)
 		dependencies = extract_file_nodes(flatten(dependency));
 	for(Node t : targets) {
 		for(Node d : dependencies) {
-			add_edge(t, d, graph);
+			add_dependency(t, d);
 		}
 	}
 }
@@ -149,5 +151,19 @@ void Precious(py::args args)
 	}
 }
 
+void Pool(const std::string& name, unsigned int capacity)
+{
+	declare_pool(name, capacity);
+}
+
+void Decider(py::object function)
+{
+	if(!py::isinstance<py::str>(function)) {
+		logging::warning() << "Ignoring Decider function, only names of the builtin deciders are supported\n";
+		return;
+	}
+	set_decider(function.cast<std::string>());
+}
+
 }
 }
@@ -49,6 +49,8 @@ namespace python_interface
 	void AlwaysBuild(py::args args);
 	py::object FindFile(const std::string& name, py::object dir_objs);
 	void Precious(py::args args);
+	void Pool(const std::string& name, unsigned int capacity);
+	void Decider(py::object function);
 
 	template<typename T>
 	inline T subst_arg(const Environment&, const T& val) { return val; }
@@ -212,6 +212,8 @@ PYBIND11_EMBEDDED_MODULE(SCons, m_scons)
 	def_directive(m_script, env, "Glob", &glob, "pattern"_a, "ondisk"_a = true);
 	def_directive(m_script, env, "FindFile", &FindFile, "file"_a, "dirs"_a);
 	def_directive(m_script, env, "Precious", &Precious);
+	def_directive(m_script, env, "Pool", &Pool, "name"_a, "capacity"_a);
+	def_directive(m_script, env, "Decider", &Decider, "function"_a);
 
 	py::module m_script_main = m_script.def_submodule("Main");
 
@@ -28,6 +28,7 @@
 #include "node_wrapper.hpp"
 
 #include "fs_node.hpp"
+#include "build_description.hpp"
 #include "util.hpp"
 
 using std::string;
@@ -105,6 +106,7 @@ py::object SConscript(const std::string& script)
 		set_fs_root(sconstruct_dir);
 	}
 	SConscriptFile sconscript_file(system_complete(boost::filesystem::path(script)), ns);
+	build_description::record_input(SConscriptFile::current().path().string());
 
 	scoped_chdir chdir(SConscriptFile::current().dir());
 
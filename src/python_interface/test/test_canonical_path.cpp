@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+
+#include "fs_node.hpp"
+
+namespace sconspp
+{
+
+BOOST_AUTO_TEST_SUITE(CanonicalPath)
+
+void check_against_boost(const std::string& name)
+{
+	std::string buffer;
+	std::string fast { canonical_path(name, buffer) };
+	BOOST_CHECK_MESSAGE(fast == canonical_path(name).native(), "'" << name << "': '" << fast << "' != '" << canonical_path(name).native() << "'");
+}
+
+BOOST_AUTO_TEST_CASE(test_special_cases)
+{
+	std::string root = get_fs_root().native();
+	std::string buffer;
+	BOOST_CHECK(canonical_path("#", buffer) == ".");
+	BOOST_CHECK(canonical_path("#foo/./bar/../baz", buffer) == "foo/baz");
+	BOOST_CHECK(canonical_path("#foo/", buffer) == "foo/.");
+	BOOST_CHECK(canonical_path(root, buffer) == ".");
+
+	for(const char* name : {
+		"#", "#/", "#.", "#..", "#../..", ".", "..", "./", "/", "//", "///", "//net/share", "/..", "/../x",
+		"x/", "x//", "x/.", "x/..", "x/../..", ".x/..", "x./..", "../x", ".../..", "#/x/../..", "/tmp/", "/tmp/."
+		})
+		check_against_boost(name);
+	check_against_boost(root);
+	check_against_boost(root + "/");
+	check_against_boost(root + "x");
+	check_against_boost(root + "/x/..");
+	check_against_boost(root + "/x/../..");
+	check_against_boost(root + "/../" + boost::filesystem::path(root).filename().native() + "/x");
+}
+
+BOOST_AUTO_TEST_CASE(test_random_paths)
+{
+	std::vector<std::string> components { "a", "b", ".", "..", ".x", "x.", "...", "tmp" };
+	for(const path& component : get_fs_root())
+		if(component != "/")
+			components.push_back(component.native());
+
+	std::mt19937 rng;
+	for(int i = 0; i < 100000; i++) {
+		std::string name;
+		switch(rng() % 3) {
+			case 0: name = "#"; break;
+			case 1: name = "/"; break;
+		}
+		int count = rng() % 7;
+		for(int j = 0; j < count; j++) {
+			if(j)
+				name.append(rng() % 6 ? 1 : 2, '/');
+			name += components[rng() % components.size()];
+		}
+		if(rng() % 8 == 0)
+			name += '/';
+		if(!name.empty())
+			check_against_boost(name);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -0,0 +1,116 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem/fstream.hpp>
+
+#include "fs_node.hpp"
+#include "db.hpp"
+
+namespace sconspp
+{
+
+BOOST_AUTO_TEST_SUITE(ChangeDetection)
+
+// Timestamps are pinned to the same second so that only size, inode, ctime
+// or contents can tell the edit apart, like with an edit made within the
+// timestamp granularity of the filesystem right after a build
+void write_file(const path& file, const std::string& contents)
+{
+	boost::filesystem::ofstream(file) << contents;
+	boost::filesystem::last_write_time(file, 1700000000);
+}
+
+bool unchanged_after_edit(enum FSEntry::change_detection mode, const std::string& new_contents, bool replace)
+{
+	path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories(dir);
+	path file = dir / "file", db_file = dir / "sconsppsign.sqlite";
+	write_file(file, "old contents");
+
+	Node node = add_entry(file.native());
+	FSEntry& entry = properties<FSEntry>(node);
+	entry.change_detection = mode;
+	{
+		PersistentData db { db_file.native() };
+		entry.unchanged(db.record_current_data(node));
+	}
+
+	if(replace) {
+		write_file(dir / "new", new_contents);
+		boost::filesystem::rename(dir / "new", file);
+	} else
+		write_file(file, new_contents);
+	entry.forget_stat();
+
+	bool result;
+	{
+		PersistentData db { db_file.native() };
+		result = entry.unchanged(db.record_current_data(node));
+	}
+	boost::filesystem::remove_all(dir);
+	return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_stat_md5)
+{
+	BOOST_CHECK(!unchanged_after_edit(FSEntry::change_detection::stat_md5, "new, longer contents", false));
+	BOOST_CHECK(!unchanged_after_edit(FSEntry::change_detection::stat_md5, "new contents", true));
+	BOOST_CHECK(unchanged_after_edit(FSEntry::change_detection::stat_md5, "old contents", true));
+	BOOST_CHECK(unchanged_after_edit(FSEntry::change_detection::timestamp_match, "new, longer contents", false));
+}
+
+// chmod, cp -p and the like change only the ctime or inode. The record has to
+// take the new values or the file would be hashed on every build after
+BOOST_AUTO_TEST_CASE(test_stat_md5_records_new_stat)
+{
+	path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories(dir);
+	path file = dir / "file", db_file = dir / "sconsppsign.sqlite";
+	write_file(file, "contents");
+
+	Node node = add_entry(file.native());
+	FSEntry& entry = properties<FSEntry>(node);
+	entry.change_detection = FSEntry::change_detection::stat_md5;
+	{
+		PersistentData db { db_file.native() };
+		entry.unchanged(db.record_current_data(node));
+	}
+
+	boost::filesystem::permissions(file, boost::filesystem::owner_read);
+	entry.forget_stat();
+	{
+		PersistentData db { db_file.native() };
+		BOOST_CHECK(entry.unchanged(db.record_current_data(node)));
+	}
+
+	entry.forget_stat();
+	{
+		PersistentData db { db_file.native() };
+		PersistentNodeData& data = db.record_current_data(node);
+		BOOST_CHECK(data.ctime() == entry.stat().ctime);
+		BOOST_CHECK(entry.unchanged(data));
+	}
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_set_decider)
+{
+	Node existing = add_entry("decider_test_existing");
+	set_decider("MD5-timestamp");
+	BOOST_CHECK(properties<FSEntry>(existing).change_detection == FSEntry::change_detection::stat_md5);
+	BOOST_CHECK(properties<FSEntry>(add_entry("decider_test_new")).change_detection == FSEntry::change_detection::stat_md5);
+	set_decider("timestamp-match");
+	BOOST_CHECK(properties<FSEntry>(existing).change_detection == FSEntry::change_detection::timestamp_match);
+	set_decider("MD5-timestamp");
+	set_decider("timestamp-newer");
+	BOOST_CHECK(properties<FSEntry>(existing).change_detection == FSEntry::change_detection::timestamp_match);
+	set_decider("MD5-timestamp");
+	set_decider("no-such-decider");
+	BOOST_CHECK(properties<FSEntry>(existing).change_detection == FSEntry::change_detection::stat_md5);
+	BOOST_CHECK_THROW(set_decider("no-such-decider", true), std::runtime_error);
+	set_decider("MD5");
+	BOOST_CHECK(properties<FSEntry>(existing).change_detection == FSEntry::change_detection::timestamp_md5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -0,0 +1,62 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "fs_node.hpp"
+#include "db.hpp"
+#include "util.hpp"
+
+namespace sconspp
+{
+
+BOOST_AUTO_TEST_SUITE(SignatureDb)
+
+BOOST_AUTO_TEST_CASE(test_migrate_version_5)
+{
+	path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	boost::filesystem::create_directories(dir);
+	std::string db_file = (dir / "sconsppsign.sqlite").native();
+	Node node = add_entry("migrated_target");
+	{
+		// Schema of the last release
+		SQLite::Db db { db_file };
+		db.exec("PRAGMA user_version = 5");
+		db.exec("create table nodes "
+			"(id INTEGER PRIMARY KEY, node_id INTEGER, generation INTEGER, type TEXT, name TEXT, existed INTEGER, timestamp INTEGER, signature BLOB, task_signature BLOB, task_status INTEGER)");
+		db.exec("create index node_identity_index on nodes (type, name)");
+		db.exec("create unique index node_archive_index on nodes (generation, type, name)");
+		db.exec("create index node_id_index on nodes (node_id)");
+		db.exec("create table dependencies (target_id INTEGER, source_id INTEGER, FOREIGN KEY(source_id) REFERENCES nodes(id))");
+		db.exec("create index source_dep_index on dependencies(source_id)");
+		db.exec("create index target_dep_index on dependencies(target_id)");
+		db.exec("create table scanner_cache (node_id INTEGER, include INTEGER, system BOOLEAN)");
+		db.exec("create index scanner_cache_index on scanner_cache(node_id)");
+		db.exec("insert into nodes (node_id, generation, type, name, existed, timestamp, signature, task_status) "
+			"values (1, 1, 'fs', '" + graph[node]->name() + "', 1, 1700000000, x'000102030405060708090a0b0c0d0e0f', 0)");
+	}
+
+	HashAlgorithm selected_algorithm = hash_algorithm;
+	hash_algorithm = HashAlgorithm::md5;
+	{
+		PersistentData db { db_file };
+		PersistentNodeData& data = db.record_current_data(node);
+		BOOST_CHECK(data.existed() == boost::optional<bool>(true));
+		BOOST_CHECK(data.timestamp() == boost::optional<time_t>(1700000000));
+		BOOST_CHECK(data.task_status() == boost::optional<int>(0));
+		BOOST_REQUIRE(data.signature());
+		BOOST_CHECK_EQUAL(data.signature()->at(15), 15);
+		BOOST_CHECK(!data.task_duration());
+		BOOST_CHECK(!data.mtime());
+	}
+	{
+		SQLite::Db db { db_file };
+		BOOST_CHECK_EQUAL(db.exec<int>("PRAGMA user_version"), 8);
+		BOOST_CHECK_EQUAL(db.exec<std::string>("select value from settings where name == 'hash'"), "md5");
+	}
+	hash_algorithm = selected_algorithm;
+	boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -20,6 +20,7 @@
 #include "scan_cpp.hpp"
 #include "fs_node.hpp"
 #include <iostream>
+#include <mutex>
 
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/phoenix_core.hpp>
@@ -67,16 +68,31 @@ struct cpp : grammar<Iterator, IncludeDeps() >
 }
 
 // HACK: need a general framework for env lookup caching.
-std::vector<std::string>& lookup_searchpath(const sconspp::Environment& env)
+// CPPPATH may be a python variable whose lookup takes the GIL, so this must
+// not be called with graph_mutex held.
+const std::vector<std::string>& lookup_searchpath(const sconspp::Environment& env)
 {
 	static std::unordered_map<const sconspp::Environment*, std::vector<std::string> > lookup_cache;
-	if(!lookup_cache.count(&env)) {
-		lookup_cache[&env];
-		for(std::string dir : env["CPPPATH"]->to_string_list()) {
-			lookup_cache[&env].push_back(dir);
-		}
+	static std::mutex lookup_cache_mutex;
+	{
+		std::lock_guard<std::mutex> lock { lookup_cache_mutex };
+		auto cached = lookup_cache.find(&env);
+		if(cached != lookup_cache.end())
+			return cached->second;
 	}
-	return lookup_cache[&env];
+	std::list<std::string> directories = env["CPPPATH"]->to_string_list();
+	std::lock_guard<std::mutex> lock { lookup_cache_mutex };
+	return lookup_cache.emplace(&env, std::vector<std::string>(directories.begin(), directories.end())).first->second;
+}
+
+// Called with graph_mutex held, as it guards the interned search paths too.
+sconspp::SearchPath intern_env_searchpath(const sconspp::Environment& env, const std::vector<std::string>& directories)
+{
+	static std::unordered_map<const sconspp::Environment*, sconspp::SearchPath> intern_cache;
+	auto cached = intern_cache.find(&env);
+	if(cached == intern_cache.end())
+		cached = intern_cache.emplace(&env, sconspp::intern_search_path(directories)).first;
+	return cached->second;
 }
 
 namespace sconspp
@@ -84,29 +100,40 @@ namespace sconspp
     void scan_cpp(const Environment& env, Node target, Node source)
 	{
 		try {
-			PersistentData& db = get_global_db();
-			IncludeDeps& deps = db.record_current_data(source).scanner_cache();
-			if(!graph[source]->unchanged(db.record_current_data(source))) {
-				deps.clear();
-				std::string contents = properties<FSEntry>(source).get_contents();
-				std::string::iterator iter(contents.begin()), iend(contents.end());
-				cpp<std::string::iterator> preprocessor;
-				parse(iter, iend, preprocessor, deps);
+			// Headers are scanned for many targets at once, so the cached
+			// includes are copied out under the source's lock
+			IncludeDeps deps;
+			{
+				PersistentNodeData& source_data = get_global_db().record_current_data(source);
+				std::lock_guard<std::mutex> lock { source_data.mutex() };
+				IncludeDeps& cached_deps = source_data.scanner_cache();
+				if(!graph[source]->unchanged(source_data)) {
+					cached_deps.clear();
+					std::string contents = properties<FSEntry>(source).get_contents();
+					std::string::iterator iter(contents.begin()), iend(contents.end());
+					cpp<std::string::iterator> preprocessor;
+					parse(iter, iend, preprocessor, cached_deps);
+				}
+				deps = cached_deps;
 			}
 
+			const std::vector<std::string>& directories = lookup_searchpath(env);
+			boost::optional<SearchPath> search_path, quoted_search_path;
 			for(const IncludeDeps::value_type& item : deps) {
-				std::vector<std::string> search_paths = lookup_searchpath(env);
-				if(!item.first) {
-					std::string source_dir(properties<FSEntry>(source).dir());
-					search_paths.push_back(source_dir);
-				}
-				boost::optional<Node> included_file = find_file(item.second, search_paths, true);
-				if(included_file) {
-					bool added;
-					boost::tie(boost::tuples::ignore, added) = add_edge(target, *included_file, graph);
-					if(added) // Only recurse into newly added edges to prevent infinite recursion in case of circular includes
-						scan_cpp(env, target, *included_file);
+				bool added = false;
+				boost::optional<Node> included_file;
+				{
+					std::lock_guard<std::mutex> lock { graph_mutex };
+					if(!search_path)
+						search_path = intern_env_searchpath(env, directories);
+					if(!item.first && !quoted_search_path)
+						quoted_search_path = extend_search_path(*search_path, properties<FSEntry>(source).dir());
+					included_file = find_file(item.second, item.first ? *search_path : *quoted_search_path);
+					if(included_file)
+						added = add_dependency(target, *included_file);
 				}
+				if(added) // Only recurse into newly added edges to prevent infinite recursion in case of circular includes
+					scan_cpp(env, target, *included_file);
 			}
 		} catch(const std::bad_cast&) {}
 	}
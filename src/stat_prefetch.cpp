@@ -0,0 +1,234 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "stat_prefetch.hpp"
+#include "fs_node.hpp"
+#include "log.hpp"
+
+namespace sconspp
+{
+
+namespace
+{
+	struct PendingStat
+	{
+		FSEntry* entry;
+		std::string path;
+		struct statx buf;
+		int error;
+	};
+
+	// Just enough of io_uring to submit statx requests and wait for them,
+	// talking to the kernel directly to avoid depending on liburing.
+	class StatRing
+	{
+		static constexpr unsigned int ring_entries = 256;
+
+		int fd_ = -1;
+		void* sq_ring_ = MAP_FAILED;
+		void* cq_ring_ = MAP_FAILED;
+		std::size_t sq_ring_size_ = 0, cq_ring_size_ = 0;
+		io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+		std::size_t sqes_size_ = 0;
+		io_uring_params params_ {};
+
+		unsigned int* sq_tail_;
+		unsigned int* sq_mask_;
+		unsigned int* sq_array_;
+		unsigned int* cq_head_;
+		unsigned int* cq_tail_;
+		unsigned int* cq_mask_;
+		io_uring_cqe* cqes_;
+
+		template<class T> T* at(void* ring, unsigned int offset) { return reinterpret_cast<T*>(static_cast<char*>(ring) + offset); }
+
+		public:
+		StatRing()
+		{
+			fd_ = syscall(__NR_io_uring_setup, ring_entries, &params_);
+			if(fd_ < 0)
+				return;
+
+			sq_ring_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned int);
+			cq_ring_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+			if(params_.features & IORING_FEAT_SINGLE_MMAP)
+				sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+			sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+			if(sq_ring_ == MAP_FAILED)
+				return;
+			if(params_.features & IORING_FEAT_SINGLE_MMAP)
+				cq_ring_ = sq_ring_;
+			else
+				cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+			if(cq_ring_ == MAP_FAILED)
+				return;
+			sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+			sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+
+			sq_tail_ = at<unsigned int>(sq_ring_, params_.sq_off.tail);
+			sq_mask_ = at<unsigned int>(sq_ring_, params_.sq_off.ring_mask);
+			sq_array_ = at<unsigned int>(sq_ring_, params_.sq_off.array);
+			cq_head_ = at<unsigned int>(cq_ring_, params_.cq_off.head);
+			cq_tail_ = at<unsigned int>(cq_ring_, params_.cq_off.tail);
+			cq_mask_ = at<unsigned int>(cq_ring_, params_.cq_off.ring_mask);
+			cqes_ = at<io_uring_cqe>(cq_ring_, params_.cq_off.cqes);
+		}
+		~StatRing()
+		{
+			if(sqes_ != MAP_FAILED)
+				munmap(sqes_, sqes_size_);
+			if(cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+				munmap(cq_ring_, cq_ring_size_);
+			if(sq_ring_ != MAP_FAILED)
+				munmap(sq_ring_, sq_ring_size_);
+			if(fd_ >= 0)
+				close(fd_);
+		}
+
+		bool usable() const { return sqes_ != MAP_FAILED; }
+
+		// Stores the errors of the finished stats and returns how many finished
+		unsigned int reap(PendingStat* begin, bool& supported)
+		{
+			unsigned int head = *cq_head_, completed = 0;
+			unsigned int cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+			for(; head != cq_tail; head++, completed++) {
+				const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+				begin[cqe.user_data].error = cqe.res < 0 ? -cqe.res : 0;
+				// Kernels before 5.6 know io_uring but not its statx
+				if(cqe.res == -EINVAL)
+					supported = false;
+			}
+			__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+			return completed;
+		}
+
+		// Returns false if the kernel doesn't support statx through io_uring
+		// or won't let the ring be entered, in which case the stats have to
+		// be done again some other way
+		bool stat(PendingStat* begin, PendingStat* end)
+		{
+			while(begin != end) {
+				unsigned int batch = std::min<std::size_t>(end - begin, params_.sq_entries);
+				unsigned int tail = *sq_tail_;
+				for(unsigned int i = 0; i < batch; i++) {
+					unsigned int index = (tail + i) & *sq_mask_;
+					io_uring_sqe& sqe = sqes_[index];
+					std::memset(&sqe, 0, sizeof sqe);
+					sqe.opcode = IORING_OP_STATX;
+					sqe.fd = AT_FDCWD;
+					sqe.addr = reinterpret_cast<std::uintptr_t>(begin[i].path.c_str());
+					sqe.len = FileStat::statx_mask;
+					sqe.off = reinterpret_cast<std::uintptr_t>(&begin[i].buf);
+					sqe.user_data = i;
+					sq_array_[index] = index;
+				}
+				__atomic_store_n(sq_tail_, tail + batch, __ATOMIC_RELEASE);
+
+				unsigned int submitted = 0, completed = 0;
+				bool supported = true;
+				while(completed < batch) {
+					int result = syscall(__NR_io_uring_enter, fd_, batch - submitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if(result < 0 && errno != EINTR && errno != EBUSY) {
+						// Seccomp or container policy may allow setting up a ring
+						// but not entering it. Whatever the kernel already took
+						// still writes into the stat buffers, so it's waited for
+						// before the caller stats everything again.
+						logging::debug() << "io_uring_enter failed: " << strerror(errno) << "\n";
+						while(completed < submitted) {
+							completed += reap(begin, supported);
+							if(completed < submitted)
+								sched_yield();
+						}
+						return false;
+					}
+					if(result > 0)
+						submitted += result;
+					completed += reap(begin, supported);
+				}
+				if(!supported)
+					return false;
+				begin += batch;
+			}
+			return true;
+		}
+	};
+
+	void stat_on_threads(std::vector<PendingStat>& stats)
+	{
+		// Enough threads to keep a disk's queue busy rather than to use the CPU
+		unsigned int num_threads = std::min<std::size_t>(std::max(std::thread::hardware_concurrency() * 2, 8u), stats.size() / 64 + 1);
+		std::atomic<std::size_t> next { 0 };
+		auto worker = [&]() {
+			for(std::size_t i = next++; i < stats.size(); i = next++) {
+				PendingStat& stat = stats[i];
+				stat.error = statx(AT_FDCWD, stat.path.c_str(), 0, FileStat::statx_mask, &stat.buf) == 0 ? 0 : errno;
+			}
+		};
+		std::vector<std::thread> threads;
+		for(unsigned int i = 1; i < num_threads; i++)
+			threads.emplace_back(worker);
+		worker();
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+void prefetch_stats(const std::vector<Node>& nodes)
+{
+	std::vector<PendingStat> stats;
+	for(Node node : nodes) {
+		if(properties(node).type_tag != FSEntry::tag)
+			continue;
+		FSEntry& entry = properties<FSEntry>(node);
+		if(!entry.has_stat())
+			stats.push_back({ &entry, entry.abspath(), {}, 0 });
+	}
+	if(stats.empty())
+		return;
+
+	StatRing ring;
+	if(!ring.usable() || !ring.stat(stats.data(), stats.data() + stats.size())) {
+		logging::debug() << "io_uring is not available, prefetching stats on threads\n";
+		stat_on_threads(stats);
+	}
+
+	for(const PendingStat& stat : stats) {
+		if(stat.error == 0)
+			stat.entry->set_stat(FileStat::from_statx(stat.buf));
+		else if(stat.error == ENOENT || stat.error == ENOTDIR)
+			stat.entry->set_stat(FileStat {});
+		// Anything else is left for FSEntry::stat to report
+	}
+}
+
+}
@@ -0,0 +1,37 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef STAT_PREFETCH_HPP
+#define STAT_PREFETCH_HPP
+
+#include <vector>
+
+#include "dependency_graph.hpp"
+
+namespace sconspp
+{
+	// Stats the filesystem entries among nodes that weren't stat'ed yet in
+	// batches through io_uring, or from a few threads if io_uring isn't
+	// available, so that deciders find the results cached instead of
+	// waiting on each file in turn.
+	void prefetch_stats(const std::vector<Node>& nodes);
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include "log.hpp"
 #include "node_properties.hpp"
 #include "fs_node.hpp"
+#include "trace.hpp"
 
 namespace sconspp
 {
@@ -40,7 +41,7 @@ void Task::add_sources(const NodeList& sources)
 	std::copy(sources.begin(), sources.end(), std::back_inserter(sources_));
 	for(const Node& target : targets_)
 		for(const Node& source : sources)
-			add_edge(target, source, graph);
+			add_dependency(target, source);
 }
 
 Environment::const_pointer Task::env() const
@@ -69,9 +70,11 @@ bool Task::database_decider(NodeList targets)
 		// check if dependencies have changed
 		std::set<int>
 			prev_sources{ target_data.dependencies() };
-		for(Edge dependency : boost::make_iterator_range(out_edges(build_target, graph))) {
-			Node build_source = target(dependency, graph);
+		std::size_t target_id = graph[build_target]->id;
+		for(std::size_t i = 0, n = frozen_graph.num_dependencies(target_id); i < n; i++) {
+			Node build_source = frozen_graph.dependency(target_id, i);
 			auto& source_data = db.record_current_data(build_source);
+			std::lock_guard<std::mutex> source_lock { source_data.mutex() };
 			int source_id = source_data.id();
 
 			bool unchanged;
@@ -88,6 +91,7 @@ bool Task::database_decider(NodeList targets)
 					if(archive_record) {
 						prev_sources.erase(archive_record.get());
 						auto& archive_data = db.get_archive_data(archive_record.get());
+						std::lock_guard<std::mutex> archive_lock { archive_data.mutex() };
 						unchanged = graph[build_source]->unchanged(archive_data);
 						logging::debug(logging::Taskmaster) << graph[build_source]->name() << " is an archived dependency\n";
 					} else {
@@ -147,10 +151,10 @@ boost::optional<boost::array<unsigned char, 16> > Task::signature() const
 	boost::optional<boost::array<unsigned char, 16> > result;
 	if(actions_.empty())
 		return result;
-	MD5 md5_sum;
+	ContentHash hash;
 	for(const Action::pointer& action : actions_)
-		md5_sum.append(action->to_string(*env(), true));
-	return md5_sum.finish();
+		hash.append(action->to_string(*env(), true));
+	return hash.finish();
 }
 
 int Task::execute() const
@@ -158,7 +162,10 @@ int Task::execute() const
 	Environment::const_pointer task_env = env();
 	int status = 0;
 	for(const Action::pointer& action : actions_) {
+		std::int64_t trace_start = trace::enabled ? trace::timestamp() : 0;
 		status = sconspp::execute(action, *task_env);
+		if(trace::enabled)
+			trace::complete("action", action->to_string(*task_env), trace_start, "{\"status\":" + std::to_string(status) + "}");
 		if(status != 0)
 			break;
 	}
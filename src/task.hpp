@@ -28,6 +28,8 @@
 #include <boost/array.hpp>
 #include <boost/optional.hpp>
 #include <boost/function.hpp>
+#include <algorithm>
+#include <mutex>
 
 namespace sconspp
 {
@@ -67,10 +69,27 @@ class Task
 	bool timestamp_pure_decider(NodeList targets);
 	bool (Task::*decider)(NodeList) = &Task::database_decider;
 
-	void add_requested_target(Node target) { requested_targets.push_back(target); }
-	bool is_up_to_date() { return (this->*decider)(requested_targets); }
-
+	void add_requested_target(Node target)
+	{
+		if(std::find(requested_targets.begin(), requested_targets.end(), target) == requested_targets.end())
+			requested_targets.push_back(target);
+	}
+	bool is_up_to_date()
+	{
+		// every requested target has its own build order entry and may be checked concurrently
+		std::lock_guard<std::mutex> lock { decider_mutex_ };
+		return (this->*decider)(requested_targets);
+	}
+
+	// Name of the resource pool the task is admitted through, if any, and
+	// how much of the pool's capacity it takes while running.
+	const std::string& pool() const { return pool_; }
+	unsigned int pool_weight() const { return pool_weight_; }
+	void set_pool(const std::string& pool, unsigned int weight = 1) { pool_ = pool; pool_weight_ = weight; }
+
+	bool has_scanner() const { return bool(scanner_); }
 	void scan(Node target, Node source) const { if(scanner_) scanner_(*env_, target, source); }
+	const Scanner& scanner() const { return scanner_; }
 	void set_scanner(Scanner scanner) { scanner_ = scanner; }
 
 	boost::optional<boost::array<unsigned char, 16> > signature() const;
@@ -88,7 +107,12 @@ class Task
 
 	Scanner scanner_;
 
+	std::string pool_;
+	unsigned int pool_weight_ = 1;
+
 	NodeList requested_targets;
+
+	std::mutex decider_mutex_;
 };
 
 }
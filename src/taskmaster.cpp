@@ -19,33 +19,27 @@
  ***************************************************************************/
 
 #include <boost/graph/topological_sort.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
+#include <boost/scope_exit.hpp>
 #include <thread>
-#include <future>
+#include <chrono>
+#include <queue>
+#include <deque>
 #include <condition_variable>
 #include <map>
+#include <algorithm>
 #include <iostream>
 
 #include "taskmaster.hpp"
 #include "task.hpp"
 #include "node_properties.hpp"
 #include "log.hpp"
+#include "util.hpp"
+#include "make_jobserver.hpp"
+#include "trace.hpp"
+#include "fs_node.hpp"
+#include "stat_prefetch.hpp"
 
 using std::vector;
-using boost::depth_first_visit;
-using boost::associative_property_map;
-
-using boost::multi_index_container;
-using boost::multi_index::indexed_by;
-using boost::multi_index::tag;
-using boost::multi_index::sequenced;
-using boost::multi_index::ordered_non_unique;
-using boost::multi_index::hashed_unique;
-using boost::multi_index::member;
 
 using boost::tie;
 
@@ -53,55 +47,103 @@ namespace {
 
 using namespace sconspp;
 
-enum TaskState { SCHEDULED, BLOCKED, TO_BUILD, BUILT, FAILED };
+enum TaskState { SCHEDULED, BLOCKED, CHECKING, TO_BUILD, BUILT, FAILED };
+
+struct PoolState;
 
 struct BuildOrderEntry
 {
 	Node node;
 	Task::pointer task;
-	mutable TaskState state { TO_BUILD };
+	mutable TaskState state { BLOCKED };
+
+	// Number of dependencies that haven't finished building yet and the
+	// entries waiting for this one. Filled in by parallel_build.
+	mutable std::size_t num_pending_deps = 0;
+	mutable bool dependency_failed = false;
+	mutable std::vector<const BuildOrderEntry*> dependents;
+
+	// Position in the build order and the estimated time in milliseconds
+	// from starting this entry until the end goal can be finished.
+	mutable std::size_t order = 0;
+	mutable std::int64_t critical_path = 0;
+
+	// Resource pool of the task, if it has one.
+	mutable PoolState* pool = nullptr;
 };
 
-struct task_tag {};
-struct node_tag {};
+// Ready entries on the longest remaining path go first, ties are broken by build order.
+struct CriticalPathFirst
+{
+	bool operator()(const BuildOrderEntry* a, const BuildOrderEntry* b) const
+	{
+		if(a->critical_path != b->critical_path)
+			return a->critical_path < b->critical_path;
+		return a->order > b->order;
+	}
+};
 
-typedef multi_index_container<
-	BuildOrderEntry,
-	indexed_by<
-		sequenced<>,
-		ordered_non_unique<tag<task_tag>, member<BuildOrderEntry, Task::pointer, &BuildOrderEntry::task>>,
-		hashed_unique<tag<node_tag>, member<BuildOrderEntry, Node, &BuildOrderEntry::node>>
-	>
-> BuildOrder;
+typedef std::priority_queue<const BuildOrderEntry*, std::vector<const BuildOrderEntry*>, CriticalPathFirst> ReadyQueue;
 
-class BuildVisitor : public boost::default_dfs_visitor
+// Weight of the running tasks from a resource pool and the entries waiting
+// for its capacity. A task heavier than the whole pool may run alone.
+struct PoolState
 {
-	BuildOrder& build_order_;
+	unsigned int capacity;
+	unsigned int used = 0;
+	ReadyQueue waiting;
+
+	bool fits(unsigned int weight) const { return used == 0 || used + weight <= capacity; }
+};
+
+// Entries in the order they can be built in, with lookup by node id.
+class BuildOrder
+{
+	std::vector<BuildOrderEntry> entries_;
+	std::vector<std::size_t> positions_;
+	static constexpr std::size_t npos = std::size_t(-1);
 
 	public:
-	BuildVisitor(BuildOrder& build_order) : build_order_(build_order) {}
+	typedef std::vector<BuildOrderEntry>::const_iterator const_iterator;
+	typedef std::vector<BuildOrderEntry>::const_reverse_iterator const_reverse_iterator;
 
-	template <typename Edge>
-	void back_edge(const Edge&, const Graph& graph) const { throw boost::not_a_dag(); }
-	void discover_vertex(Node node, const Graph& graph) const
+	void push_back(BuildOrderEntry&& entry)
 	{
-		Task::pointer task = graph[node]->task();
-		if(!task) return;
-
-		for(auto edge : make_iterator_range(out_edges(node, graph))) {
-			task->scan(source(edge, graph), target(edge, graph));
-		}
+		std::size_t id = graph[entry.node]->id;
+		if(id >= positions_.size())
+			positions_.resize(id + 1, npos);
+		positions_[id] = entries_.size();
+		entries_.push_back(std::move(entry));
 	}
-	void finish_vertex(Node node, const Graph& graph) const
+	const BuildOrderEntry& at(Node node) const
 	{
-		Task::pointer task = graph[node]->task();
-		if(task && !task->actions().empty()) {
-			task->add_requested_target(node);
-		} else task = {};
-		build_order_.push_back({ node, task });
+		return at_id(graph[node]->id);
 	}
+	const BuildOrderEntry& at_id(std::size_t id) const
+	{
+		return entries_[positions_[id]];
+	}
+	bool contains_id(std::size_t id) const
+	{
+		return id < positions_.size() && positions_[id] != npos;
+	}
+
+	const_iterator begin() const { return entries_.begin(); }
+	const_iterator end() const { return entries_.end(); }
+	const_reverse_iterator rbegin() const { return entries_.rbegin(); }
+	const_reverse_iterator rend() const { return entries_.rend(); }
+	const BuildOrderEntry& back() const { return entries_.back(); }
 };
 
+void finish_vertex(Node node, BuildOrder& build_order)
+{
+	Task::pointer task = graph[node]->task();
+	if(task && !task->actions().empty()) {
+		task->add_requested_target(node);
+	} else task = {};
+	build_order.push_back({ node, task });
+}
+
 }
 
 /*
@@ -128,75 +170,355 @@ namespace sconspp
 	boost::optional<unsigned int> num_jobs;
 	bool always_build;
 	bool keep_going;
+	boost::optional<double> max_load;
+	boost::optional<double> max_memory_pressure;
+	boost::optional<std::vector<std::string>> affected_by;
 
 	std::function<void*()> pre_build_hook;
 	std::function<void(void*)> post_build_hook;
 
-	void build_order(Node end_goal, BuildOrder& output)
+	static std::map<std::string, unsigned int> pool_capacities;
+
+	void declare_pool(const std::string& name, unsigned int capacity)
+	{
+		if(capacity == 0)
+			throw std::runtime_error("Capacity of pool '" + name + "' must be at least 1");
+		pool_capacities[name] = capacity;
+	}
+
+	const std::map<std::string, unsigned int>& declared_pools()
 	{
-		std::map<Node, boost::default_color_type> colors;
-		associative_property_map<std::map<Node, boost::default_color_type> > color_map(colors);
-		depth_first_visit(graph, end_goal, BuildVisitor(output), color_map);
+		return pool_capacities;
+	}
+
+	// Depth first search over frozen_graph that visits dependencies in the
+	// same order as depth_first_visit would. Colors are indexed by node id and
+	// grow on demand since scanners may add nodes while it runs. If affected
+	// is given, only dependencies it marks are visited.
+	void build_order(Node end_goal, BuildOrder& output, bool scan, const std::vector<bool>* affected = nullptr)
+	{
+		struct Frame
+		{
+			Node node;
+			std::size_t id;
+			std::size_t next_dependency;
+		};
+		std::vector<boost::default_color_type> colors;
+		std::vector<Frame> stack;
+
+		auto discover = [&](Node node, std::size_t id) {
+			if(id >= colors.size())
+				colors.resize(id + 1, boost::white_color);
+			colors[id] = boost::gray_color;
+			Task::pointer task = scan ? graph[node]->task() : Task::pointer();
+			if(task) {
+				std::size_t num_dependencies = frozen_graph.num_dependencies(id);
+				for(std::size_t i = 0; i < num_dependencies; i++)
+					task->scan(node, frozen_graph.dependency(id, i));
+			}
+			stack.push_back({ node, id, 0 });
+		};
+
+		discover(end_goal, graph[end_goal]->id);
+		while(!stack.empty()) {
+			Frame& frame = stack.back();
+			if(frame.next_dependency < frozen_graph.num_dependencies(frame.id)) {
+				std::size_t id = frozen_graph.dependency_id(frame.id, frame.next_dependency++);
+				if(affected && (id >= affected->size() || !(*affected)[id]))
+					continue;
+				boost::default_color_type color = id < colors.size() ? colors[id] : boost::white_color;
+				if(color == boost::white_color)
+					discover(frozen_graph.node(id), id);
+				else if(color == boost::gray_color)
+					throw boost::not_a_dag();
+			} else {
+				colors[frame.id] = boost::black_color;
+				Node node = frame.node;
+				stack.pop_back();
+				finish_vertex(node, output);
+			}
+		}
 	}
 
 	void build_order(Node end_goal, std::vector<Node>& output)
 	{
+		GraphFreeze freeze;
 		BuildOrder nodes;
-		build_order(end_goal, nodes);
+		build_order(end_goal, nodes, true);
 
 		std::transform(nodes.begin(), nodes.end(), std::back_inserter(output), [](const BuildOrderEntry& node) -> Node { return node.node; } );
 	}
 
 	class JobServer
 	{
-		typedef std::vector<std::pair<Node,int>> ResultVec;
+		public:
+		enum class JobType { check, execute, scan };
+		struct Result
+		{
+			Node node;
+			JobType type;
+			// exit status of the task, or 0 if check found the task up-to-date
+			int status;
+			std::chrono::milliseconds duration;
+		};
+		typedef std::vector<Result> ResultVec;
+
+		private:
+		struct Job
+		{
+			Node node;
+			JobType type;
+			// source to scan for scan jobs
+			Node source;
+		};
+
 		ResultVec result_vec;
+		std::deque<Job> queue;
+		std::vector<std::thread> workers;
+		std::size_t num_idle_workers = 0;
 		std::size_t num_scheduled_jobs = 0;
+		// checks and scans, which don't take job slots
+		std::size_t num_scheduled_checks = 0;
+		bool shutting_down = false;
+		bool throttled = false;
+		bool waiting_for_token = false;
+		std::chrono::steady_clock::time_point last_load_sample;
+		std::unique_ptr<MakeJobserver> make_jobserver;
+		bool make_jobserver_initialized = false;
+		std::condition_variable queue_cv;
 		std::condition_variable num_scheduled_jobs_cv;
 		std::mutex num_scheduled_jobs_mutex;
 
-		public:
-		void schedule(Node node)
+		void run_worker()
 		{
-			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
-			std::packaged_task<void()> ptask{ [this, node]() {
+			std::unique_lock<std::mutex> lock { num_scheduled_jobs_mutex };
+			while(true) {
+				num_idle_workers++;
+				queue_cv.wait(lock, [this]{ return shutting_down || !queue.empty(); });
+				num_idle_workers--;
+				if(queue.empty())
+					return;
+				Job job = queue.front();
+				Node node = job.node;
+				JobType type = job.type;
+				queue.pop_front();
+				lock.unlock();
+
 				int result;
+				auto start_time = std::chrono::steady_clock::now();
+				std::int64_t trace_start = trace::enabled ? trace::timestamp() : 0;
 				try {
-					result = graph[node]->task()->execute();
+					if(type == JobType::check) {
+						result = graph[node]->task()->is_up_to_date() ? 0 : 1;
+					} else if(type == JobType::scan) {
+						graph[node]->task()->scan(node, job.source);
+						result = 0;
+					} else {
+						result = graph[node]->task()->execute();
+					}
 				} catch(std::exception& e) {
 					result = -1;
 					logging::error(logging::Taskmaster) <<
-						"Exception during execution of task: " << e.what() << std::endl;
+						(type == JobType::check ? "Exception during up-to-date check of task: " :
+						 type == JobType::scan ? "Exception during dependency scanning: " : "Exception during execution of task: ") << e.what() << std::endl;
 				}
-				std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
-				num_scheduled_jobs--;
+
+				if(trace::enabled) {
+					if(type == JobType::scan)
+						trace::complete("scan", graph[job.source]->name(), trace_start, "{\"target\":" + trace::quote(graph[node]->name()) + "}");
+					else
+						trace::complete(type == JobType::check ? "check" : "task", graph[node]->name(), trace_start,
+							"{\"status\":" + std::to_string(result) + "}");
+				}
+
+				lock.lock();
+				if(type == JobType::execute)
+					num_scheduled_jobs--;
+				else
+					num_scheduled_checks--;
 				num_scheduled_jobs_cv.notify_one();
-				result_vec.emplace_back(node, result);
-			} };
+				result_vec.push_back({ node, type, result,
+					std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time) });
+			}
+		}
+
+		void enqueue(Node node, JobType type, Node source = Node())
+		{
+			queue.push_back({ node, type, source });
+			// Workers are spawned lazily and kept around for subsequent builds.
+			// Besides num_jobs workers running tasks there are as many workers as
+			// the hardware can run for up-to-date checks and scans, so those
+			// don't wait for long running tasks to finish.
+			std::size_t max_workers = (num_jobs ? num_jobs.get() : num_scheduled_jobs) + std::max(std::thread::hardware_concurrency(), 1u);
+			if(num_idle_workers < queue.size() && workers.size() < max_workers)
+				workers.emplace_back(&JobServer::run_worker, this);
+			queue_cv.notify_one();
+		}
+
+		// Checks load average and memory pressure against the limits given on
+		// command line. Both are updated by the kernel every few seconds so they
+		// are sampled at most once per second.
+		bool system_overloaded()
+		{
+			if(!max_load && !max_memory_pressure)
+				return false;
+			auto now = std::chrono::steady_clock::now();
+			if(now - last_load_sample < std::chrono::seconds(1))
+				return throttled;
+			last_load_sample = now;
+
+			boost::optional<double> load = max_load ? load_average() : boost::none;
+			boost::optional<double> pressure = max_memory_pressure ? memory_pressure() : boost::none;
+			bool was_throttled = throttled;
+			throttled = (load && load.get() > max_load.get()) || (pressure && pressure.get() > max_memory_pressure.get());
+			if(throttled) {
+				// Report when throttling starts and keep reporting it on debug level while it lasts
+				std::ostream& log = was_throttled ? logging::debug(logging::Taskmaster) << "" : logging::info(logging::Taskmaster) << "";
+				log << "Not starting new jobs:";
+				if(load && load.get() > max_load.get())
+					log << " load average " << load.get() << " is above " << max_load.get() << ".";
+				if(pressure && pressure.get() > max_memory_pressure.get())
+					log << " memory pressure " << pressure.get() << "% is above " << max_memory_pressure.get() << "%.";
+				log << "\n";
+			} else if(was_throttled) {
+				logging::info(logging::Taskmaster) << "System load is back under limits, resuming starting new jobs.\n";
+			}
+			return throttled;
+		}
+
+		// Every running job except one needs a token from make's jobserver.
+		// Tokens that aren't needed anymore are returned right away so that
+		// other processes sharing the jobserver can use them.
+		void release_unused_tokens()
+		{
+			while(make_jobserver && make_jobserver->num_tokens() > 0 && make_jobserver->num_tokens() >= num_scheduled_jobs)
+				make_jobserver->release();
+		}
+
+		public:
+		~JobServer()
+		{
+			{
+				std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+				shutting_down = true;
+				queue.clear();
+			}
+			queue_cv.notify_all();
+			for(auto& worker : workers)
+				worker.join();
+		}
+
+		void schedule(Node node)
+		{
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
 			num_scheduled_jobs++;
-			std::thread thread(std::move(ptask));
-			thread.detach();
+			enqueue(node, JobType::execute);
+		}
+		void check(Node node)
+		{
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+			num_scheduled_checks++;
+			enqueue(node, JobType::check);
+		}
+		void scan(Node target, Node source)
+		{
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+			num_scheduled_checks++;
+			enqueue(target, JobType::scan, source);
 		}
+		// Join the jobserver of a parent make. Has to be done before num_jobs
+		// is autodetected since under a parent make autodetection is left to
+		// its jobserver.
+		void setup_make_jobserver()
+		{
+			if(make_jobserver_initialized)
+				return;
+			make_jobserver_initialized = true;
+			make_jobserver = MakeJobserver::from_makeflags();
+			if(make_jobserver) {
+				logging::debug(logging::Taskmaster) << "Using jobserver of parent make.\n";
+				if(num_jobs && num_jobs.get() == 0)
+					num_jobs = boost::none;
+			}
+		}
+		// Without a parent make serve as a jobserver for child processes,
+		// once num_jobs is known
+		void serve_make_jobserver()
+		{
+			if(!make_jobserver && num_jobs && num_jobs.get() > 1)
+				make_jobserver = MakeJobserver::serve(num_jobs.get());
+		}
+
+		// Should be called only when there is a job to schedule, since it
+		// may take a token from make's jobserver for it.
 		bool have_free_slots()
 		{
-			return !num_jobs || num_scheduled_jobs < num_jobs.get();
+			bool overloaded = system_overloaded();
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+			if(num_jobs && num_scheduled_jobs >= num_jobs.get())
+				return false;
+			// Always allow at least one job so the build makes progress no matter what.
+			if(num_scheduled_jobs == 0)
+				return true;
+			if(overloaded)
+				return false;
+			waiting_for_token = make_jobserver && make_jobserver->num_tokens() < num_scheduled_jobs && !make_jobserver->try_acquire();
+			return !waiting_for_token;
+		}
+		std::size_t num_running_jobs()
+		{
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+			return num_scheduled_jobs;
+		}
+		std::size_t num_running_checks()
+		{
+			std::lock_guard<std::mutex> lock { num_scheduled_jobs_mutex };
+			return num_scheduled_checks;
 		}
 		ResultVec wait_for_results()
 		{
 			std::unique_lock<std::mutex> lock(num_scheduled_jobs_mutex);
-			num_scheduled_jobs_cv.wait(lock, [this]{ return have_free_slots(); });
+			auto have_results = [this]{ return !result_vec.empty() || (num_scheduled_jobs == 0 && num_scheduled_checks == 0); };
+			// While throttled or out of jobserver tokens wake up periodically to see if more jobs can be started.
+			if(waiting_for_token)
+				num_scheduled_jobs_cv.wait_for(lock, std::chrono::milliseconds(50), have_results);
+			else if(throttled)
+				num_scheduled_jobs_cv.wait_for(lock, std::chrono::seconds(1), have_results);
+			else
+				num_scheduled_jobs_cv.wait(lock, have_results);
+			waiting_for_token = false;
+			release_unused_tokens();
 			return std::move(result_vec);
 		}
 		void wait_for_all()
 		{
 			std::unique_lock<std::mutex> lock(num_scheduled_jobs_mutex);
-			num_scheduled_jobs_cv.wait(lock, [this]{ return num_scheduled_jobs == 0; });
+			// Drop jobs that haven't been picked up by a worker yet and wait only for running ones
+			for(const auto& job : queue) {
+				if(job.type == JobType::execute)
+					num_scheduled_jobs--;
+				else
+					num_scheduled_checks--;
+			}
+			queue.clear();
+			num_scheduled_jobs_cv.wait(lock, [this]{ return num_scheduled_jobs == 0 && num_scheduled_checks == 0; });
+			result_vec.clear();
+			waiting_for_token = false;
+			release_unused_tokens();
 		}
 	};
 
+	JobServer& get_job_server()
+	{
+		static JobServer job_server;
+		return job_server;
+	}
+
 	int parallel_build(BuildOrder& nodes, PersistentData& db)
 	{
 		int job_counter = 0;
+		JobServer& job_server = get_job_server();
+		job_server.setup_make_jobserver();
 		if(num_jobs) {
 			if(num_jobs.get() == 0)
 				num_jobs = std::thread::hardware_concurrency();
@@ -209,69 +531,192 @@ namespace sconspp
 		} else {
 			logging::debug(logging::Taskmaster) << "Will execute unlimited number of parallel jobs.\n";
 		}
+		job_server.serve_make_jobserver();
+
+		std::int64_t trace_start = trace::enabled ? trace::timestamp() : 0;
+		std::size_t order = 0;
+		std::int64_t total_known_duration = 0, num_known_durations = 0;
+		std::map<std::string, PoolState> pools;
+		for(const auto& entry : nodes) {
+			entry.order = order++;
+			std::size_t id = graph[entry.node]->id;
+			for(std::size_t i = 0, n = frozen_graph.num_dependencies(id); i < n; i++) {
+				std::size_t dependency = frozen_graph.dependency_id(id, i);
+				// Left out by --affected-by
+				if(!nodes.contains_id(dependency))
+					continue;
+				nodes.at_id(dependency).dependents.push_back(&entry);
+				entry.num_pending_deps++;
+			}
+			if(entry.task && !entry.task->pool().empty()) {
+				auto capacity = pool_capacities.find(entry.task->pool());
+				if(capacity == pool_capacities.end())
+					throw std::runtime_error("Target " + properties(entry.node).name() + " is assigned to undeclared pool '" + entry.task->pool() + "'");
+				entry.pool = &pools[capacity->first];
+				entry.pool->capacity = capacity->second;
+			}
+			if(entry.task) {
+				auto duration = db.record_current_data(entry.node).task_duration();
+				if(duration) {
+					entry.critical_path = duration.get();
+					total_known_duration += duration.get();
+					num_known_durations++;
+				} else {
+					entry.critical_path = -1;
+				}
+			}
+		}
 
-		JobServer job_server;
+		// Tasks that were never built before are assumed to take as long as an average task.
+		// Walking the build order backwards visits all dependents of an entry before the entry itself.
+		std::int64_t estimated_duration = num_known_durations ? std::max<std::int64_t>(total_known_duration / num_known_durations, 1) : 1;
+		ReadyQueue ready_queue;
+		for(auto entry = nodes.rbegin(); entry != nodes.rend(); entry++) {
+			if(entry->critical_path < 0)
+				entry->critical_path = estimated_duration;
+			std::int64_t longest_dependent = 0;
+			for(auto dependent : entry->dependents)
+				longest_dependent = std::max(longest_dependent, dependent->critical_path);
+			entry->critical_path += longest_dependent;
+			if(entry->num_pending_deps == 0) {
+				entry->state = TO_BUILD;
+				ready_queue.push(&*entry);
+			}
+		}
 
-		auto get_state {
-			[&nodes](Node node) -> TaskState& {
-				return nodes.get<node_tag>().find(node)->state;
+		if(trace::enabled)
+			trace::complete("phase", "Estimate critical paths", trace_start);
+
+		// Release entries waiting for a finished one. Failures are propagated to
+		// dependents without scheduling them, using an explicit stack since
+		// dependency chains can be very long.
+		auto finish {
+			[&ready_queue](const BuildOrderEntry& finished) {
+				std::vector<const BuildOrderEntry*> stack { &finished };
+				while(!stack.empty()) {
+					const BuildOrderEntry& entry = *stack.back();
+					stack.pop_back();
+					for(auto dependent : entry.dependents) {
+						if(entry.state == FAILED)
+							dependent->dependency_failed = true;
+						if(--dependent->num_pending_deps == 0) {
+							if(dependent->dependency_failed) {
+								dependent->state = FAILED;
+								stack.push_back(dependent);
+							} else {
+								dependent->state = TO_BUILD;
+								ready_queue.push(dependent);
+							}
+						}
+					}
+				}
 			}
 		};
 
-		auto last_node = --nodes.end();
-		while(last_node->state != BUILT && last_node->state != FAILED) {
-			for(const auto& result : job_server.wait_for_results()) {
-				auto& node_data { db.record_current_data(result.first) };
-				properties(result.first).unchanged(node_data);
-				node_data.task_status() = result.second;
-				if(result.second == 0) {
-					job_counter++;
-					get_state(result.first) = BUILT;
+		// Up-to-date checks of ready entries run on the job server's workers
+		// and don't take job slots. Entries that need rebuilding wait in
+		// out_of_date_queue for a free slot, and in their pool's queue while
+		// the pool is full.
+		ReadyQueue out_of_date_queue;
+		const BuildOrderEntry& last_node = nodes.back();
+		while(last_node.state != BUILT && last_node.state != FAILED) {
+			while(!ready_queue.empty()) {
+				const BuildOrderEntry& entry = *ready_queue.top();
+				ready_queue.pop();
+
+				if(!entry.task) {
+					entry.state = BUILT;
+					finish(entry);
 				} else {
-					get_state(result.first) = FAILED;
-					if(!keep_going) {
-						logging::warning(logging::Taskmaster) << "Task failed. Waiting for the rest of active tasks to finish...\n";
-						job_server.wait_for_all();
-						throw std::runtime_error("Task failed");
-					}
+					job_server.check(entry.node);
+					entry.state = CHECKING;
 				}
 			}
+			while(!out_of_date_queue.empty()) {
+				const BuildOrderEntry& entry = *out_of_date_queue.top();
+				if(entry.pool && !entry.pool->fits(entry.task->pool_weight())) {
+					logging::debug(logging::Taskmaster)
+						<< "Pool '" << entry.task->pool() << "' is full. Target " << properties(entry.node).name() << " waits for it.\n";
+					out_of_date_queue.pop();
+					entry.pool->waiting.push(&entry);
+					continue;
+				}
+				if(!job_server.have_free_slots()) {
+					logging::debug(logging::Taskmaster)
+						<< "All slots taken. Waiting...\n";
+					break;
+				}
+				out_of_date_queue.pop();
+				if(entry.pool)
+					entry.pool->used += entry.task->pool_weight();
+				if(trace::enabled)
+					trace::async_end("queue", "Waiting for a job slot", entry.order);
+
+				job_server.schedule(entry.node);
+				logging::debug(logging::Taskmaster)
+					<< "Scheduled building target " << properties(entry.node).name() << ".\n";
+				entry.state = SCHEDULED;
+			}
+			if(last_node.state == BUILT || last_node.state == FAILED)
+				break;
 
-			for(auto node { nodes.begin() }; node != nodes.end(); node++) {
-				if(node->state == BLOCKED || node->state == TO_BUILD) {
-					node->state = TO_BUILD;
-				} else continue;
+			if(trace::enabled) {
+				trace::counter("Jobs", "{\"running\":" + std::to_string(job_server.num_running_jobs()) +
+					",\"checking\":" + std::to_string(job_server.num_running_checks()) + "}");
+				trace::counter("Ready queue", "{\"depth\":" + std::to_string(out_of_date_queue.size()) + "}");
+			}
 
-				for(Edge e : boost::make_iterator_range(out_edges(node->node, graph))) {
-					if(get_state(target(e, graph)) == SCHEDULED ||
-					   get_state(target(e, graph)) == BLOCKED) {
-						node->state = BLOCKED;
+			for(const auto& result : job_server.wait_for_results()) {
+				const BuildOrderEntry& entry = nodes.at(result.node);
+				if(result.type == JobServer::JobType::check && result.status >= 0) {
+					if(result.status == 0 && !always_build) {
+						entry.state = BUILT;
+						finish(entry);
+					} else {
+						entry.state = TO_BUILD;
+						out_of_date_queue.push(&entry);
+						if(trace::enabled)
+							trace::async_begin("queue", "Waiting for a job slot", entry.order);
 					}
-					if(get_state(target(e, graph)) == FAILED) {
-						node->state = FAILED;
-						break;
+					continue;
+				}
+
+				if(result.type == JobServer::JobType::execute && entry.pool) {
+					// Hand the freed capacity to waiting entries in priority order
+					PoolState& pool = *entry.pool;
+					pool.used -= entry.task->pool_weight();
+					std::int64_t available = std::int64_t(pool.capacity) - pool.used;
+					bool pool_empty = pool.used == 0;
+					while(!pool.waiting.empty() && (pool_empty || pool.waiting.top()->task->pool_weight() <= available)) {
+						available -= pool.waiting.top()->task->pool_weight();
+						pool_empty = false;
+						out_of_date_queue.push(pool.waiting.top());
+						pool.waiting.pop();
 					}
 				}
-				if(node->state == TO_BUILD) {
-					auto t = node->task;
-					if(!t || (t->is_up_to_date() && !always_build)) {
-						node->state = BUILT;
-					} else {
-						job_server.schedule(node->node);
-						logging::debug(logging::Taskmaster)
-							<< "Scheduled building target " << properties(node->node).name() << ".\n";
-						node->state = SCHEDULED;
-						if(!job_server.have_free_slots()) {
-							logging::debug(logging::Taskmaster)
-								<< "All slots taken. Waiting...\n";
-							break;
-						}
+				if(result.type == JobServer::JobType::execute) {
+					auto& node_data { db.record_current_data(result.node) };
+					std::lock_guard<std::mutex> lock { node_data.mutex() };
+					properties(result.node).unchanged(node_data);
+					node_data.task_status() = result.status;
+					node_data.task_duration() = result.duration.count();
+				}
+				if(result.status == 0) {
+					job_counter++;
+					entry.state = BUILT;
+				} else {
+					entry.state = FAILED;
+					if(!keep_going) {
+						logging::warning(logging::Taskmaster) << "Task failed. Waiting for the rest of active tasks to finish...\n";
+						job_server.wait_for_all();
+						throw std::runtime_error("Task failed");
 					}
 				}
+				finish(entry);
 			}
 		}
 
-		if(nodes.get<task_tag>().begin()->task == (--nodes.get<task_tag>().end())->task && nodes.get<task_tag>().begin()->task == Task::pointer{}) {
+		if(std::none_of(nodes.begin(), nodes.end(), [](const BuildOrderEntry& entry) { return bool(entry.task); })) {
 			logging::info(logging::Taskmaster) << "celebration of laziness: no actions assigned to target(s).\n";
 		} else {
 			if(job_counter == 0) logging::info(logging::Taskmaster) << "celebration of laziness: all targets up-to-date.\n";
@@ -279,15 +724,174 @@ namespace sconspp
 		return job_counter;
 	}
 
+	// Runs scanners of all tasks reachable from end_goal on the job server's
+	// workers, so that build_order doesn't have to scan one edge at a time.
+	// Dependencies of a node are followed only once all its scans are done
+	// since scanners add edges to it and may give tasks to its sources.
+	void scan_dependencies(Node end_goal)
+	{
+		JobServer& job_server = get_job_server();
+		std::vector<bool> visited;
+		std::vector<std::size_t> pending_scans;
+		std::vector<Node> scanned;
+		std::size_t num_outstanding = 0;
+		bool failed = false;
+
+		auto visit = [&](Node node) {
+			std::lock_guard<std::mutex> lock { graph_mutex };
+			std::size_t id = graph[node]->id;
+			if(id >= visited.size()) {
+				visited.resize(id + 1);
+				pending_scans.resize(id + 1);
+			}
+			if(visited[id])
+				return;
+			visited[id] = true;
+			Task::pointer task = graph[node]->task();
+			if(task && task->has_scanner()) {
+				for(std::size_t i = 0, n = frozen_graph.num_dependencies(id); i < n; i++) {
+					job_server.scan(node, frozen_graph.dependency(id, i));
+					pending_scans[id]++;
+					num_outstanding++;
+				}
+			}
+			if(pending_scans[id] == 0)
+				scanned.push_back(node);
+		};
+
+		visit(end_goal);
+		while(true) {
+			while(!scanned.empty() && !failed) {
+				Node node = scanned.back();
+				scanned.pop_back();
+				NodeList dependencies;
+				{
+					std::lock_guard<std::mutex> lock { graph_mutex };
+					std::size_t id = graph[node]->id;
+					for(std::size_t i = 0, n = frozen_graph.num_dependencies(id); i < n; i++)
+						dependencies.push_back(frozen_graph.dependency(id, i));
+				}
+				for(Node dependency : dependencies)
+					visit(dependency);
+			}
+			if(num_outstanding == 0)
+				break;
+			for(const auto& result : job_server.wait_for_results()) {
+				num_outstanding--;
+				if(result.status != 0)
+					failed = true;
+				if(--pending_scans[graph[result.node]->id] == 0)
+					scanned.push_back(result.node);
+			}
+		}
+		if(failed)
+			throw std::runtime_error("Dependency scanning failed");
+	}
+
+	// Marks by id the given files and everything depending on them
+	std::vector<bool> affected_nodes(const std::vector<std::string>& files)
+	{
+		std::vector<bool> affected(frozen_graph.num_ids());
+		std::vector<std::size_t> queue;
+		for(const std::string& file : files) {
+			boost::optional<Node> node = get_entry(file);
+			if(!node) {
+				logging::debug(logging::Taskmaster) << "'" << file << "' is not part of the build\n";
+				continue;
+			}
+			std::size_t id = graph[node.get()]->id;
+			if(id >= affected.size())
+				affected.resize(id + 1);
+			if(!affected[id]) {
+				affected[id] = true;
+				queue.push_back(id);
+			}
+		}
+		while(!queue.empty()) {
+			std::size_t id = queue.back();
+			queue.pop_back();
+			for(std::size_t i = 0, n = frozen_graph.num_dependents(id); i < n; i++) {
+				std::size_t dependent = frozen_graph.dependent_id(id, i);
+				if(!affected[dependent]) {
+					affected[dependent] = true;
+					queue.push_back(dependent);
+				}
+			}
+		}
+		return affected;
+	}
+
+	// Marks by id everything end_goal depends on, directly or not
+	std::vector<bool> reachable_nodes(Node end_goal)
+	{
+		std::vector<bool> reachable(frozen_graph.num_ids());
+		std::vector<std::size_t> queue { graph[end_goal]->id };
+		reachable[queue.back()] = true;
+		while(!queue.empty()) {
+			std::size_t id = queue.back();
+			queue.pop_back();
+			for(std::size_t i = 0, n = frozen_graph.num_dependencies(id); i < n; i++) {
+				std::size_t dependency = frozen_graph.dependency_id(id, i);
+				if(!reachable[dependency]) {
+					reachable[dependency] = true;
+					queue.push_back(dependency);
+				}
+			}
+		}
+		return reachable;
+	}
+
 	int build(Node end_goal)
 	{
 		void* hook_data = pre_build_hook ? pre_build_hook() : nullptr;
-		BuildOrder nodes;
-		build_order(end_goal, nodes);
+		// Also when the build fails, since watch mode goes on to build again
+		BOOST_SCOPE_EXIT( (hook_data) ) {
+			if(post_build_hook) post_build_hook(hook_data);
+		} BOOST_SCOPE_EXIT_END
 		PersistentData& db = get_global_db();
+		GraphFreeze freeze;
+		BuildOrder nodes;
+		// Scanners and their cache check the sources, so those are stat'ed
+		// before scanning rather than one at a time by each scan
+		std::vector<bool> prefetched = reachable_nodes(end_goal);
+		{
+			trace::Scope scope { "phase", "Stat prefetch" };
+			std::vector<Node> entries;
+			for(std::size_t id = 0; id < prefetched.size(); id++)
+				if(prefetched[id])
+					entries.push_back(frozen_graph.node(id));
+			prefetch_stats(entries);
+		}
+		{
+			trace::Scope scope { "phase", "Dependency scanning" };
+			scan_dependencies(end_goal);
+		}
+		{
+			trace::Scope scope { "phase", "Build order" };
+			if(!affected_by) {
+				build_order(end_goal, nodes, false);
+			} else {
+				std::vector<bool> affected = affected_nodes(affected_by.get());
+				build_order(end_goal, nodes, false, &affected);
+			}
+		}
 
-		int result = parallel_build(nodes, db);
-		if(post_build_hook) post_build_hook(hook_data);
+		{
+			trace::Scope scope { "phase", "Stat prefetch of scanned nodes" };
+			std::vector<Node> entries;
+			for(const auto& entry : nodes) {
+				std::size_t id = graph[entry.node]->id;
+				if(id >= prefetched.size() || !prefetched[id])
+					entries.push_back(entry.node);
+			}
+			prefetch_stats(entries);
+		}
+
+		int result;
+		{
+			trace::Scope scope { "phase", "Build" };
+			result = parallel_build(nodes, db);
+		}
 		return result;
 	}
 }
@@ -23,6 +23,10 @@
 
 #include <boost/optional/optional_fwd.hpp>
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "dependency_graph.hpp"
 
 namespace sconspp
@@ -30,10 +34,19 @@ namespace sconspp
 	extern boost::optional<unsigned int> num_jobs;
 	extern bool always_build;
 	extern bool keep_going;
+	extern boost::optional<double> max_load;
+	extern boost::optional<double> max_memory_pressure;
+	// If set only targets depending on these files get built
+	extern boost::optional<std::vector<std::string>> affected_by;
 
 	extern std::function<void*()> pre_build_hook;
 	extern std::function<void(void*)> post_build_hook;
 
+	// Tasks assigned to a pool run only while the weights of running tasks
+	// from that pool fit in its capacity.
+	void declare_pool(const std::string& name, unsigned int capacity);
+	const std::map<std::string, unsigned int>& declared_pools();
+
 	int build(Node end_goal);
 
 	void build_order(Node end_goal, std::vector<Node>& nodes);
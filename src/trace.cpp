@@ -0,0 +1,142 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include "trace.hpp"
+
+namespace sconspp
+{
+namespace trace
+{
+
+bool enabled = false;
+
+namespace
+{
+	std::ofstream trace_file;
+	std::mutex trace_mutex;
+	bool first_event = true;
+	std::chrono::steady_clock::time_point start_time;
+	std::atomic<int> next_thread_id { 1 };
+
+	int thread_id()
+	{
+		thread_local int id = next_thread_id++;
+		return id;
+	}
+
+	void write_event(const std::string& event)
+	{
+		std::lock_guard<std::mutex> lock { trace_mutex };
+		trace_file << (first_event ? "\n" : ",\n") << event;
+		first_event = false;
+	}
+
+	std::string event_head(const char* phase, const char* category, const std::string& name, std::int64_t ts)
+	{
+		std::ostringstream os;
+		os << "{\"ph\":\"" << phase << "\",\"cat\":\"" << category << "\",\"name\":" << quote(name)
+			<< ",\"pid\":1,\"tid\":" << thread_id() << ",\"ts\":" << ts;
+		return os.str();
+	}
+}
+
+void start(const std::string& filename)
+{
+	trace_file.open(filename);
+	if(!trace_file)
+		throw std::runtime_error("Failed to open trace file " + filename);
+	trace_file << "[";
+	start_time = std::chrono::steady_clock::now();
+	enabled = true;
+	std::atexit(finish);
+	write_event("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"scons++\"}}");
+}
+
+void finish()
+{
+	if(!enabled)
+		return;
+	enabled = false;
+	std::lock_guard<std::mutex> lock { trace_mutex };
+	trace_file << "\n]\n";
+	trace_file.close();
+}
+
+std::int64_t timestamp()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+std::string quote(const std::string& str)
+{
+	std::string result = "\"";
+	for(char c : str) {
+		switch(c) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if(static_cast<unsigned char>(c) < 0x20) {
+					char escaped[7];
+					std::snprintf(escaped, sizeof escaped, "\\u%04x", c);
+					result += escaped;
+				} else {
+					result += c;
+				}
+		}
+	}
+	return result + "\"";
+}
+
+void complete(const char* category, const std::string& name, std::int64_t start, const std::string& args)
+{
+	std::string event = event_head("X", category, name, start) + ",\"dur\":" + std::to_string(timestamp() - start);
+	if(!args.empty())
+		event += ",\"args\":" + args;
+	write_event(event + "}");
+}
+
+void async_begin(const char* category, const std::string& name, std::uint64_t id)
+{
+	write_event(event_head("b", category, name, timestamp()) + ",\"id\":" + std::to_string(id) + "}");
+}
+
+void async_end(const char* category, const std::string& name, std::uint64_t id)
+{
+	write_event(event_head("e", category, name, timestamp()) + ",\"id\":" + std::to_string(id) + "}");
+}
+
+void counter(const char* name, const std::string& args)
+{
+	write_event(event_head("C", "counter", name, timestamp()) + ",\"args\":" + args + "}");
+}
+
+}
+}
@@ -0,0 +1,67 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <string>
+
+/* Timeline of the build in Chrome's trace event format, viewable in
+ * chrome://tracing or Perfetto. Everything here is meant to be called only
+ * after checking trace::enabled so that it costs nothing when --trace isn't
+ * given.
+ */
+namespace sconspp
+{
+namespace trace
+{
+	extern bool enabled;
+
+	void start(const std::string& filename);
+	void finish();
+
+	// Microseconds since tracing started
+	std::int64_t timestamp();
+
+	std::string quote(const std::string& str);
+
+	// Event spanning from start until now on the calling thread. args is
+	// a JSON object or empty.
+	void complete(const char* category, const std::string& name, std::int64_t start, const std::string& args = std::string());
+	// Events that may overlap anything else, matched by category, name and id
+	void async_begin(const char* category, const std::string& name, std::uint64_t id);
+	void async_end(const char* category, const std::string& name, std::uint64_t id);
+	void counter(const char* name, const std::string& args);
+
+	class Scope
+	{
+		const char* category_;
+		const char* name_;
+		std::int64_t start_;
+
+		public:
+		Scope(const char* category, const char* name) : category_(category), name_(name), start_(enabled ? timestamp() : 0) {}
+		~Scope() { if(enabled) complete(category_, name_, start_); }
+	};
+}
+}
+
+#endif
@@ -19,11 +19,15 @@
  ***************************************************************************/
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <vector>
+#include <algorithm>
+#include <fstream>
+#include <limits>
 #include <boost/version.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
@@ -32,9 +36,14 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/scope_exit.hpp>
 
+#include "config.hpp"
 #include "log.hpp"
 #include "util.hpp"
 
+#ifdef HAVE_LIBXXHASH
+#include <xxhash.h>
+#endif
+
 using std::string;
 
 namespace sconspp
@@ -180,25 +189,173 @@ std::pair<int, std::vector<string>> exec(const std::vector<string>& args, bool c
 	}
 }
 
-boost::array<unsigned char, 16> MD5::hash_file(const std::string& filename)
+boost::optional<double> load_average()
 {
-	MD5 md5;
-	FILE* file = fopen(filename.c_str(), "r");
-	BOOST_SCOPE_EXIT( (&file) ) {
-		fclose(file);
-	} BOOST_SCOPE_EXIT_END
+	std::ifstream loadavg("/proc/loadavg");
+	double result;
+	if(loadavg >> result)
+		return result;
+	return {};
+}
+
+unsigned int parse_positive_number(const std::string& str, const std::string& what)
+{
+	try {
+		unsigned int result = boost::lexical_cast<unsigned int>(str);
+		if(result > 0)
+			return result;
+	} catch(const boost::bad_lexical_cast&) {
+	}
+	throw std::runtime_error(what + " must be a positive number, got '" + str + "'");
+}
+
+boost::optional<double> memory_pressure()
+{
+	static const boost::filesystem::path pressure_file {
+		[]() -> boost::filesystem::path {
+			std::ifstream cgroup("/proc/self/cgroup");
+			string line;
+			while(std::getline(cgroup, line)) {
+				if(line.compare(0, 3, "0::") == 0) {
+					boost::filesystem::path cgroup_pressure = "/sys/fs/cgroup" + line.substr(3) + "/memory.pressure";
+					if(boost::filesystem::exists(cgroup_pressure))
+						return cgroup_pressure;
+				}
+			}
+			return "/proc/pressure/memory";
+		}()
+	};
+
+	std::ifstream pressure(pressure_file.string());
+	string kind, avg10;
+	while(pressure >> kind >> avg10) {
+		if(kind == "some" && avg10.compare(0, 6, "avg10=") == 0)
+			return std::strtod(avg10.c_str() + 6, nullptr);
+		pressure.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+	}
+	return {};
+}
 
-	if(file == nullptr) throw boost::system::system_error(errno, boost::system::system_category(), "util::MD5::hash_file: Failed to open " + filename);
-	while(!feof(file)) {
-		const int blocksize = 4096;
-		unsigned char buffer[blocksize];
+#ifdef HAVE_LIBXXHASH
+HashAlgorithm hash_algorithm = HashAlgorithm::xxh3_128;
+#else
+HashAlgorithm hash_algorithm = HashAlgorithm::md5;
+#endif
 
-		size_t count = fread(buffer, 1, blocksize, file);
-		if(ferror(file)) throw boost::system::system_error(errno, boost::system::system_category(), "util::MD5::hash_file: Failed to read " + filename);
+std::istream& operator>>(std::istream& in, HashAlgorithm& algorithm)
+{
+	string token;
+	in >> token;
+	if(token == "md5")
+		algorithm = HashAlgorithm::md5;
+#ifdef HAVE_LIBXXHASH
+	else if(token == "xxh3")
+		algorithm = HashAlgorithm::xxh3_128;
+#endif
+	else
+		in.setstate(std::ios_base::failbit);
+	return in;
+}
 
-		md5.append(buffer, count);
+std::ostream& operator<<(std::ostream& out, HashAlgorithm algorithm)
+{
+	return out << (algorithm == HashAlgorithm::md5 ? "md5" : "xxh3");
+}
+
+ContentHash::ContentHash(HashAlgorithm algorithm) : algorithm_(algorithm)
+{
+	switch(algorithm_) {
+		case HashAlgorithm::md5:
+			md5_init(&md5_);
+			break;
+		case HashAlgorithm::xxh3_128:
+#ifdef HAVE_LIBXXHASH
+			xxh3_ = XXH3_createState();
+			if(!xxh3_)
+				throw std::bad_alloc();
+			XXH3_128bits_reset(xxh3_);
+#else
+			throw std::logic_error("ContentHash: built without libxxhash");
+#endif
+			break;
+	}
+}
+
+ContentHash::~ContentHash()
+{
+#ifdef HAVE_LIBXXHASH
+	if(xxh3_)
+		XXH3_freeState(xxh3_);
+#endif
+}
+
+void ContentHash::append(const unsigned char* data, size_t length)
+{
+#ifdef HAVE_LIBXXHASH
+	if(xxh3_) {
+		XXH3_128bits_update(xxh3_, data, length);
+		return;
+	}
+#endif
+	// md5_append takes an int
+	const size_t chunk = 1 << 30;
+	for(; length > chunk; data += chunk, length -= chunk)
+		md5_append(&md5_, data, chunk);
+	md5_append(&md5_, data, length);
+}
+
+boost::array<unsigned char, 16> ContentHash::finish()
+{
+	boost::array<unsigned char, 16> result;
+#ifdef HAVE_LIBXXHASH
+	if(xxh3_) {
+		XXH128_canonical_t canonical;
+		XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(xxh3_));
+		std::copy(canonical.digest, canonical.digest + 16, result.begin());
+		return result;
+	}
+#endif
+	md5_finish(&md5_, result.data());
+	return result;
+}
+
+namespace
+{
+	// Reused by all hashes done on a thread. Files up to this size take a
+	// single read(), larger ones are hashed a chunk at a time.
+	const size_t read_buffer_size = 256 * 1024;
+	unsigned char* read_buffer()
+	{
+		// Never freed, as the signature database hashes files from its
+		// destructor after thread_local objects have been destroyed
+		thread_local unsigned char* buffer = new unsigned char[read_buffer_size];
+		return buffer;
+	}
+}
+
+boost::array<unsigned char, 16> ContentHash::hash_file(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) throw boost::system::system_error(errno, boost::system::system_category(), "util::ContentHash: Failed to open " + filename);
+	BOOST_SCOPE_EXIT( (fd) ) {
+		close(fd);
+	} BOOST_SCOPE_EXIT_END
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	ContentHash hash;
+	unsigned char* buffer = read_buffer();
+	while(true) {
+		ssize_t count = read(fd, buffer, read_buffer_size);
+		if(count < 0) {
+			if(errno == EINTR)
+				continue;
+			throw boost::system::system_error(errno, boost::system::system_category(), "util::ContentHash: Failed to read " + filename);
+		}
+		if(count == 0)
+			break;
+		hash.append(buffer, count);
 	}
-	return md5.finish();
+	return hash.finish();
 }
 
 }
@@ -21,14 +21,19 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 
+#include <iosfwd>
 #include <map>
 #include <string>
 #include <vector>
 #include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/array.hpp>
 #include "md5.h"
 
+struct XXH3_state_s;
+
 namespace sconspp
 {
 
@@ -82,6 +87,15 @@ class scoped_chdir
 
 std::pair<int, std::vector<std::string> > exec(const std::vector<std::string>&, bool capture_output = false);
 
+// Throws naming what was being parsed unless str is an integer above zero
+unsigned int parse_positive_number(const std::string& str, const std::string& what);
+
+// 1-minute load average as in /proc/loadavg
+boost::optional<double> load_average();
+// Percentage of time some tasks were stalled on memory in the last 10 seconds.
+// Taken from the process' cgroup v2 memory.pressure if available or from /proc/pressure/memory.
+boost::optional<double> memory_pressure();
+
 class MD5
 {
 	md5_state_t state;
@@ -111,6 +125,30 @@ class MD5
 		md5.append((const unsigned char*)str.data(), str.length());
 		return md5.finish();
 	}
+};
+
+// Algorithm of the signatures of files and tasks. All of them are 16 bytes.
+enum struct HashAlgorithm { md5, xxh3_128 };
+std::istream& operator>>(std::istream& in, HashAlgorithm& algorithm);
+std::ostream& operator<<(std::ostream& out, HashAlgorithm algorithm);
+// XXH3 if built with libxxhash, MD5 otherwise
+extern HashAlgorithm hash_algorithm;
+
+class ContentHash : public boost::noncopyable
+{
+	HashAlgorithm algorithm_;
+	md5_state_t md5_;
+	XXH3_state_s* xxh3_ = nullptr;
+
+	public:
+	explicit ContentHash(HashAlgorithm algorithm = hash_algorithm);
+	~ContentHash();
+	void append(const unsigned char* data, size_t length);
+	void append(const std::string& data)
+	{
+		append((const unsigned char*)data.data(), data.size());
+	}
+	boost::array<unsigned char, 16> finish();
 	static boost::array<unsigned char, 16> hash_file(const std::string& filename);
 };
 
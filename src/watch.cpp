@@ -0,0 +1,219 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.hpp"
+#include "build_description.hpp"
+#include "node_properties.hpp"
+#include "fs_node.hpp"
+#include "taskmaster.hpp"
+#include "db.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace sconspp
+{
+namespace watch
+{
+
+bool enabled = false;
+
+namespace
+{
+	// Edits tend to come as several events in quick succession, such as an
+	// editor writing a temporary file and renaming it over the original
+	const int settle_time_ms = 100;
+
+	const std::uint32_t watch_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+
+	struct Changes
+	{
+		std::set<Node> nodes;
+		bool scripts_changed = false;
+		bool empty() const { return nodes.empty() && !scripts_changed; }
+	};
+
+	class Watcher
+	{
+		int fd_;
+		std::map<int, std::string> directories_;
+		std::set<std::string> watched_;
+
+		public:
+		Watcher()
+		{
+			fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if(fd_ < 0)
+				throw std::runtime_error(std::string("inotify_init1 failed: ") + strerror(errno));
+		}
+		~Watcher() { close(fd_); }
+
+		// Watches directories holding entries of the graph or inputs of the
+		// build scripts that aren't watched yet, since builds may create new ones
+		void add_directories()
+		{
+			std::set<std::string> directories;
+			for(Node node : boost::make_iterator_range(vertices(graph)))
+				if(properties(node).type_tag == FSEntry::tag)
+					directories.insert(path(properties<FSEntry>(node).abspath()).parent_path().string());
+			for(const std::string& input : build_description::inputs()) {
+				directories.insert(path(input).parent_path().string());
+				directories.insert(input);
+			}
+
+			for(const std::string& directory : directories) {
+				if(watched_.count(directory))
+					continue;
+				int wd = inotify_add_watch(fd_, directory.c_str(), watch_mask | IN_ONLYDIR);
+				if(wd < 0) {
+					// Doesn't exist yet, or isn't a directory in case of inputs
+					if(errno == ENOENT || errno == ENOTDIR)
+						continue;
+					logging::warning() << "Can't watch " << directory << ": " << strerror(errno) << "\n";
+					continue;
+				}
+				directories_[wd] = directory;
+				watched_.insert(directory);
+			}
+		}
+
+		// Reads the events that arrive within timeout_ms, -1 meaning to wait
+		// for the first one as long as it takes
+		void read_events(Changes& changes, int timeout_ms)
+		{
+			pollfd poll_fd { fd_, POLLIN, 0 };
+			while(poll(&poll_fd, 1, timeout_ms) > 0) {
+				alignas(inotify_event) char buffer[64 * 1024];
+				ssize_t length;
+				while((length = read(fd_, buffer, sizeof buffer)) > 0) {
+					for(char* pos = buffer; pos < buffer + length; ) {
+						const inotify_event& event = *reinterpret_cast<const inotify_event*>(pos);
+						pos += sizeof(inotify_event) + event.len;
+						handle_event(event, changes);
+					}
+				}
+				// Keep going until things settle
+				timeout_ms = settle_time_ms;
+			}
+		}
+
+		private:
+		void handle_event(const inotify_event& event, Changes& changes)
+		{
+			auto directory = directories_.find(event.wd);
+			if(directory == directories_.end())
+				return;
+			if(event.mask & IN_IGNORED) {
+				watched_.erase(directory->second);
+				directories_.erase(directory);
+				return;
+			}
+
+			std::string file = event.len ? directory->second + "/" + event.name : directory->second;
+			const std::set<std::string>& inputs = build_description::inputs();
+			bool entries_changed = event.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+			if(inputs.count(file) || (entries_changed && inputs.count(directory->second))) {
+				logging::debug() << "Build script input " << file << " has changed\n";
+				changes.scripts_changed = true;
+				return;
+			}
+
+			boost::optional<Node> node = get_entry(file);
+			if(node)
+				changes.nodes.insert(node.get());
+		}
+	};
+
+	// Whether a target is still the way the last build left it, in which case
+	// events on it were the build's own
+	bool as_built(Node node)
+	{
+		FSEntry& entry = properties<FSEntry>(node);
+		entry.forget_stat();
+		const PersistentNodeData& data = get_global_db().record_current_data(node);
+		if(!entry.exists())
+			return data.existed() == boost::optional<bool>(false);
+		const FileStat& stat = entry.stat();
+		return data.existed() == boost::optional<bool>(true) &&
+			data.mtime() == stat.mtime &&
+			data.size() == std::int64_t(stat.size) &&
+			data.inode() == std::int64_t(stat.inode);
+	}
+}
+
+void run(Node end_goal)
+{
+	Watcher watcher;
+	Changes changes;
+	while(true) {
+		// Write out signatures of the last build so that they're not lost
+		// when the process is killed while waiting
+		get_global_db(true);
+		watcher.add_directories();
+
+		// Whatever the build itself wrote is already known to be up-to-date,
+		// but targets changed or deleted by something else since need building
+		watcher.read_events(changes, 0);
+		for(auto node = changes.nodes.begin(); node != changes.nodes.end(); ) {
+			if(properties(*node).task() && as_built(*node))
+				node = changes.nodes.erase(node);
+			else
+				++node;
+		}
+		if(changes.empty()) {
+			logging::info() << "Watching for changes\n";
+			while(changes.empty())
+				watcher.read_events(changes, -1);
+		}
+		if(changes.scripts_changed) {
+			logging::info() << "Build scripts have changed, reading them again\n";
+			throw restart_exception();
+		}
+
+		for(Node node : boost::make_iterator_range(vertices(graph))) {
+			if(properties(node).type_tag != FSEntry::tag)
+				continue;
+			FSEntry& entry = properties<FSEntry>(node);
+			if(changes.nodes.count(node))
+				entry.forget_stat();
+			else
+				entry.forget_unchanged();
+		}
+		changes = Changes();
+		forget_file_lookups();
+
+		try {
+			build(end_goal);
+		} catch(const std::exception& e) {
+			logging::error() << e.what() << std::endl;
+		}
+	}
+}
+
+}
+}
@@ -0,0 +1,40 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Sergey Popov                                    *
+ *   loonycyborg@gmail.com                                                 *
+ *                                                                         *
+ *  This file is part of SCons++.                                          *
+ *                                                                         *
+ *  SCons++ is free software; you can redistribute it and/or modify        *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 3 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  SCons++ is distributed in the hope that it will be useful,             *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef WATCH_HPP
+#define WATCH_HPP
+
+#include "dependency_graph.hpp"
+
+namespace sconspp
+{
+namespace watch
+{
+	extern bool enabled;
+
+	// Keeps rebuilding end_goal whenever files in the graph change, reusing
+	// the graph already in memory. Returns only by throwing
+	// restart_exception once a build script or a globbed directory changes,
+	// since the graph has to be built anew from the scripts then.
+	[[ noreturn ]] void run(Node end_goal);
+}
+}
+
+#endif